@@ -18,8 +18,47 @@
  *******************************************************************************/
 
 #include "blackmoon.h"
+#include <stdio.h>
+
+/* Flags on both sides of the 64 bit word boundary */
+
+static int check_flags(void) {
+  int flags[] = {BM_FREE_INPUT, BM_SSEEK_DELIMIT, 63, 64, 100};
+  int n_flags = sizeof(flags) / sizeof(int);
+
+  struct bm_flags folded = set_flags(BM_FREE_INPUT, BM_SSEEK_DELIMIT, 63, 64, 100);
+  struct bm_flags built = bm_set_flags(BM_FREE_INPUT, BM_SSEEK_DELIMIT, 63, 64, 100, -1);
+
+  for (int at = 0; at < n_flags; at++) {
+    if (!isflag_set(folded, flags[at]) || !(isflag_set)(built, flags[at]))
+      return 1;
+  }
+
+  if (isflag_set(folded, 62) || isflag_set(folded, 65) || isflag_set(folded, -1) || \
+      isflag_set(folded, 64 * BM_FLAGS_WORDS))
+    return 1;
+
+  /* In place clears, the by-value bm_clear_flags() leaves the caller's copy alone */
+
+  clear_flags(folded, 63, 64);
+  bm_unset_flags(&built, 63, 64, -1);
+  bm_clear_flags(folded, BM_FREE_INPUT, 100, -1);
+
+  if (isflag_set(folded, 63) || isflag_set(folded, 64) || isflag_set(built, 63) || \
+      isflag_set(built, 64) || !isflag_set(folded, BM_FREE_INPUT) || !isflag_set(folded, 100) || \
+      !isflag_set(built, BM_SSEEK_DELIMIT) || !isflag_set(built, 100))
+    return 1;
+
+  return 0;
+}
 
 int main(void) {
   print_hello();
+
+  if (check_flags() != 0) {
+    fprintf(stderr, "bm_flags{} checks failed\n");
+    return 1;
+  }
+
   return 0;
 }
@@ -24,6 +24,8 @@
 #include <string.h>
 #include <limits.h>
 #include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 /* Error Defintions */
 
@@ -45,30 +47,210 @@
 #define BM_SSEEK_DELIMIT 5
 #define BM_MODE_AUTO_RETRY 6
 
+#define BM_FLAGS_WORDS 2	// 64 flags per word
+
+/* Structure Definitions */
+
+#define BM_ARENA_SLAB_SIZE 65536
+#define BM_ARENA_CLASSES 12
+#define BM_POCKET_INLINE_MAX 256
+#define BM_HASH_STRIPE 32
+#define BM_LZ_BLOCK 65536
+#define BM_LZ_BLOCK_MAX (1L << 24)
+#define BM_HTTP_MAX_HEAD 65536
+
 typedef uint8_t bit;
 
 typedef int (freeing_func)(void*);
 
+typedef int (batch_freeing_func)(void**, long);
+
 struct bm_data {
 	void *data;
 	long size;
 };
 
+struct bm_idata {	// (struct bm_data*) compatible, payload in the same allocation, see create_inline_bm_data()
+	void *data;
+	long size;
+	char inl[] __attribute__((aligned(16)));
+};
+
+struct bm_arena {
+	struct bm_slab *slab;
+	long slab_size;
+	long n_slab;
+	struct bm_pocket *f_pkt[BM_ARENA_CLASSES];	// Recycled bm_pocket{} per size class, shared by its bm_bag{}
+};
+
+struct bm_buf {	// Growable, (struct bm_data*) compatible
+	void *data;
+	long size;
+	long cap;
+};
+
+struct bm_shared {	// Reference counted buffer
+	void *data;
+	long size;
+	long refs;
+	freeing_func *ffunc;
+};
+
+struct bm_slice {	// (struct bm_data*) compatible view into a bm_shared{}
+	void *data;
+	long size;
+	struct bm_shared *shared;
+};
+
+struct bm_index {	// Fenwick tree of bm_pocket{}->size in bm_bag{} order
+	struct bm_pocket **pkt;
+	long *tree;
+	long n_slot;
+	long n_dead;
+	long cap;
+	long size;
+};
+
 struct bm_pocket {
 	struct bm_pocket *prev;
 	void *data;
 	long size;
 	struct bm_pocket *next;
+	struct bm_arena *arena;
+	long cap;
+	freeing_func *ffunc;
+	void *owner;
+	long idx;
+	char inl[] __attribute__((aligned(16)));
 };
 
 struct bm_bag {
 	struct bm_pocket *start;
 	long n_pkt;
 	struct bm_pocket *end;
+	struct bm_arena *arena;
+	struct bm_index *index;
 };
 
 struct bm_flags {
-	uint32_t f[1];
+	uint64_t f[BM_FLAGS_WORDS];
+};
+
+struct bm_map_slot {
+	struct bm_data key;
+	struct bm_data value;
+};
+
+struct bm_map {	// Open addressing, 16 wide control byte groups
+	int8_t *ctrl;
+	struct bm_map_slot *slot;
+	long cap;
+	long n_entry;
+	long growth_left;
+	int nocase;
+	freeing_func *ffunc;
+};
+
+struct bm_ring {	// Bounded single producer, single consumer
+	long head __attribute__((aligned(64)));
+	long c_tail;
+	long tail __attribute__((aligned(64)));
+	long c_head;
+	long mask __attribute__((aligned(64)));
+	struct bm_pocket **slot;
+};
+
+struct bm_mpsc {	// Unbounded multiple producer, single consumer
+	struct bm_pocket *head __attribute__((aligned(64)));
+	struct bm_pocket *tail __attribute__((aligned(64)));
+	struct bm_pocket *stub;
+};
+
+struct bm_reclaimer {	// Background thread releasing handed over bm_bag{}
+	struct bm_mpsc *queue;
+	sem_t sem;
+	pthread_t tid;
+	int stop;
+};
+
+struct bm_bitstream {	// MSB first bit cursor over a bm_data{}
+	struct bm_data *bm_data;
+	long pos;	// Next byte to load or store
+	uint64_t acc;	// Cached bits, left aligned
+	int n_acc;
+	int write;
+};
+
+struct bm_idpool {	// Lock-free allocator of small integer IDs
+	uint64_t *word;	// Set bit means taken
+	long n_word;
+	long n_id;
+	long hint;
+};
+
+struct bm_rank {	// Rank/select index over a bit array it does not own
+	uint8_t *bits;
+	unsigned long n_bit;
+	unsigned long n_one;
+	uint64_t *l0;	// Absolute rank every 2^32 bits
+	uint64_t *l12;	// Per 2048 bits, rank relative to l0 << 32 | three 10 bit sub block counts
+	long *sample;	// Block holding every 8192nd set bit
+	long n_sample;
+};
+
+struct bm_roaring {	// Compressed set of 32 bit values, one container per 64K chunk
+	struct bm_roaring_chunk *chunk;	// Sorted by the high 16 bits
+	long n_chunk;
+	long cap;
+};
+
+struct bm_packed {	// Fixed width integers, packed back to back MSB first like int_to_bitarray()
+	uint8_t *data;
+	long size;	// In elements
+	long cap;
+	int width;
+};
+
+struct bm_hash {	// Running 64-bit hash, the digest does not depend on how the input was split
+	uint64_t lane[2];
+	uint64_t key[2];	// Seeded stripe keys
+	long size;
+	uint8_t buf[BM_HASH_STRIPE];	// Partial stripe carried to the next update
+	int n_buf;
+};
+
+struct bm_lz {	// Streaming LZ coder over independent blocks of at most block_size raw bytes
+	long block_size;
+	int decode;
+	uint8_t *stage;	// Raw bytes of a partial block, or a compressed block still arriving
+	long n_stage;
+	uint8_t *scratch;	// Compressed block under construction
+	uint32_t *table;	// Match finder hash table
+};
+
+struct bm_http_header {	// Views into the parsed head
+	struct bm_data name;
+	struct bm_data value;
+};
+
+struct bm_http {	// HTTP/1.x message head, resumable as more bytes arrive
+	struct bm_data method;	// Requests
+	struct bm_data target;
+	int status;	// Responses
+	struct bm_data reason;
+	int version;	// Minor version of HTTP/1.x
+	long n_header;
+	long head_size;	// Up to and including the empty line, 0 until it is seen
+	long scanned;	// Where the search for the empty line resumes
+};
+
+struct bm_text {	// Streaming base64 or hex coder, holding a partial group between calls
+	int codec;
+	int decode;
+	int pad;	// Close base64 with '='
+	int ended;	// Padding seen, nothing may follow
+	uint8_t carry[4];
+	int n_carry;
 };
 
 /* libblackmoon.c */
@@ -77,22 +259,55 @@ extern void print_hello ();
 
 int bm_free(void *mem);
 
+int bm_batch_free(void **mem, long n_mem);
+
+int bm_free_inline(void *mem);
+
 /* flags.c */
 
-struct bm_flags bm_set_flags(int first, ...);
+/* Flags fold to constant masks, the variadic functions remain for flag lists built at run time */
+
+#define BM_FLAG_BIT(word, flag) ((unsigned int) (flag) / 64 == (word) ? 1ULL << ((unsigned int) (flag) % 64) : 0ULL)
+
+#define BM_FLAGS_WORD(word, ...) (0ULL __VA_OPT__(BM_FLAGS_EXPAND(BM_FLAGS_EACH(word, __VA_ARGS__))))
+
+#define BM_FLAGS_EACH(word, flag, ...) | BM_FLAG_BIT(word, flag) \
+		__VA_OPT__(BM_FLAGS_AGAIN BM_FLAGS_PARENS (word, __VA_ARGS__))
+#define BM_FLAGS_AGAIN() BM_FLAGS_EACH
+#define BM_FLAGS_PARENS ()
 
-#define set_flags(...) bm_set_flags(__VA_ARGS__ __VA_OPT__(,) -1)
+#define BM_FLAGS_EXPAND(...) BM_FLAGS_EXPAND3(BM_FLAGS_EXPAND3(BM_FLAGS_EXPAND3(BM_FLAGS_EXPAND3(__VA_ARGS__))))
+#define BM_FLAGS_EXPAND3(...) BM_FLAGS_EXPAND2(BM_FLAGS_EXPAND2(BM_FLAGS_EXPAND2(BM_FLAGS_EXPAND2(__VA_ARGS__))))
+#define BM_FLAGS_EXPAND2(...) BM_FLAGS_EXPAND1(BM_FLAGS_EXPAND1(BM_FLAGS_EXPAND1(BM_FLAGS_EXPAND1(__VA_ARGS__))))
+#define BM_FLAGS_EXPAND1(...) __VA_ARGS__
+
+struct bm_flags bm_set_flags(int first, ...);	// -1 terminated
+
+#define set_flags(...) ((struct bm_flags) {.f = {BM_FLAGS_WORD(0, __VA_ARGS__), BM_FLAGS_WORD(1, __VA_ARGS__)}})
 
 int isflag_set(struct bm_flags flags, int flag);
 
-int bm_clear_flags(struct bm_flags flags, ...);
+static inline int bm_isflag_set(struct bm_flags flags, int flag) {
+	return (unsigned int) flag < 64 * BM_FLAGS_WORDS ? (flags.f[flag / 64] >> (flag % 64)) & 1 : 0;
+}
+
+#define isflag_set(flags, flag) bm_isflag_set(flags, flag)
+
+int bm_clear_flags(struct bm_flags flags, ...);	// -1 terminated, works on a copy like it always has
+
+int bm_unset_flags(struct bm_flags *flags, ...);	// -1 terminated, in place
 
-#define clear_flags(flags, ...) bm_clear_flags(flags, __VA_ARGS__, -1)
+#define clear_flags(flags, ...) ({(flags).f[0] &= ~BM_FLAGS_WORD(0, __VA_ARGS__); \
+		(flags).f[1] &= ~BM_FLAGS_WORD(1, __VA_ARGS__); BM_ERROR_NONE;})
 
 /* structures.c */
 
 struct bm_data* create_bm_data(long bm_data_size);
 
+struct bm_idata* create_inline_bm_data(long bm_data_size);
+
+int free_inline_bm_data(struct bm_idata **_bm_idata);
+
 struct free_bm_data {
 	freeing_func *ffunc;
 };
@@ -102,16 +317,25 @@ int free_bm_data(struct bm_data **_bm_data, struct free_bm_data va_list);
 #define free_bm_data(_bm_data, ...) (free_bm_data)(_bm_data, \
 		(struct free_bm_data){.ffunc = bm_free, __VA_ARGS__})
 
-struct bm_bag* create_bm_bag();
+struct create_bm_bag {
+	struct bm_arena *arena;
+};
+
+struct bm_bag* create_bm_bag(struct create_bm_bag va_list);
+
+#define create_bm_bag(...) (create_bm_bag)((struct create_bm_bag) {.arena = NULL, __VA_ARGS__})
 
 struct free_bm_bag {
 	freeing_func *ffunc;
+	batch_freeing_func *bfunc;
 }; 
 
 int free_bm_bag(struct bm_bag **_bm_bag, struct free_bm_bag va_list);
 
 #define free_bm_bag(_bm_bag, ...) (free_bm_bag)(_bm_bag, \
-		(struct free_bm_bag) {.ffunc = bm_free, __VA_ARGS__})
+		(struct free_bm_bag) {.ffunc = bm_free, .bfunc = NULL, __VA_ARGS__})
+
+/* Up to BM_POCKET_INLINE_MAX, and any arena size, bm_pocket{}->data is inline: never free() or realloc() it */
 
 int append_bm_pocket(struct bm_bag* bm_bag, long bm_pocket_size);
 
@@ -124,9 +348,531 @@ int delete_bm_pocket(struct bm_bag* bm_bag, struct bm_pocket** _bm_pocket, struc
 #define delete_bm_pocket(bm_bag, _bm_pocket, ...) (delete_bm_pocket)(bm_bag, _bm_pocket, \
 		(struct delete_bm_pocket) {.ffunc = bm_free, __VA_ARGS__})
 
+struct bm_buf* create_bm_buf(long bm_buf_cap);
+
+int reserve_bm_buf(struct bm_buf *bm_buf, long bm_buf_cap);
+
+int append_bm_buf(struct bm_buf *bm_buf, void *data, long data_size);
+
+int shrink_bm_buf(struct bm_buf *bm_buf);
+
+int free_bm_buf(struct bm_buf **_bm_buf);
+
+int detach_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket);
+
+int attach_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket);
+
 int place_bm_data(struct bm_bag *bm_bag, struct bm_data *bm_data);
 
-struct bm_data* flatten_bm_bag(struct bm_bag *bm_bag);
+int adopt_bm_data(struct bm_bag *bm_bag, struct bm_data **_bm_data);
+
+int adopt_inline_bm_data(struct bm_bag *bm_bag, struct bm_idata **_bm_idata);
+
+struct borrow_bm_data {
+	freeing_func *ffunc;
+};
+
+int borrow_bm_data(struct bm_bag *bm_bag, struct bm_data *bm_data, struct borrow_bm_data va_list);
+
+#define borrow_bm_data(bm_bag, bm_data, ...) (borrow_bm_data)(bm_bag, bm_data, \
+		(struct borrow_bm_data) {.ffunc = NULL, __VA_ARGS__})
+
+int index_bm_bag(struct bm_bag *bm_bag);
+
+int resize_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket, long bm_pocket_size);
+
+long size_bm_bag(struct bm_bag *bm_bag);
+
+struct bm_pocket* locate_bm_bag(struct bm_bag *bm_bag, long offset, long *p_offset);
+
+long copy_bm_bag(struct bm_bag *bm_bag, long offset, void *buf, long length);
+
+/* flatten.c */
+
+struct flatten_bm_bag {
+	struct bm_data *into;
+	long offset;
+	long length;
+	struct bm_flags flags;
+	freeing_func *ffunc;
+	int n_thread;
+};
+
+struct bm_data* flatten_bm_bag(struct bm_bag *bm_bag, struct flatten_bm_bag va_list);
+
+#define flatten_bm_bag(bm_bag, ...) (flatten_bm_bag)(bm_bag, (struct flatten_bm_bag) \
+		{.into = NULL, .offset = 0, .length = LONG_MAX, .flags = set_flags(), .ffunc = bm_free, \
+		.n_thread = 0, __VA_ARGS__})
+
+/* arena.c */
+
+/* Memory goes back to the system only in free_bm_arena(), carves over half a slab get a dedicated bm_slab{} */
+
+struct create_bm_arena {
+	long slab_size;
+};
+
+struct bm_arena* create_bm_arena(struct create_bm_arena va_list);
+
+#define create_bm_arena(...) (create_bm_arena)((struct create_bm_arena) \
+		{.slab_size = BM_ARENA_SLAB_SIZE, __VA_ARGS__})
+
+void* carve_bm_arena(struct bm_arena *bm_arena, long carve_size);
+
+int free_bm_arena(struct bm_arena **_bm_arena);
+
+/* shared.c */
+
+struct share_bm_data {
+	freeing_func *ffunc;
+};
+
+struct bm_shared* share_bm_data(struct bm_data **_bm_data, struct share_bm_data va_list);
+
+#define share_bm_data(_bm_data, ...) (share_bm_data)(_bm_data, \
+		(struct share_bm_data) {.ffunc = bm_free, __VA_ARGS__})
+
+struct bm_shared* share_inline_bm_data(struct bm_idata **_bm_idata);
+
+struct bm_shared* hold_bm_shared(struct bm_shared *bm_shared);
+
+int release_bm_shared(struct bm_shared **_bm_shared);
+
+struct bm_slice* create_bm_slice(struct bm_shared *bm_shared, long offset, long size);
+
+int free_bm_slice(struct bm_slice **_bm_slice);
+
+int place_bm_slice(struct bm_bag *bm_bag, struct bm_slice *bm_slice);
+
+/* queue.c */
+
+struct bm_ring* create_bm_ring(long bm_ring_size);
+
+int push_bm_ring(struct bm_ring *bm_ring, struct bm_pocket *bm_pocket);
+
+long pop_bm_ring(struct bm_ring *bm_ring, struct bm_pocket **bm_pockets, long n_pkt);
+
+struct free_bm_ring {
+	freeing_func *ffunc;
+};
+
+int free_bm_ring(struct bm_ring **_bm_ring, struct free_bm_ring va_list);
+
+#define free_bm_ring(_bm_ring, ...) (free_bm_ring)(_bm_ring, \
+		(struct free_bm_ring) {.ffunc = bm_free, __VA_ARGS__})
+
+struct bm_mpsc* create_bm_mpsc();
+
+int push_bm_mpsc(struct bm_mpsc *bm_mpsc, struct bm_pocket *bm_pocket);
+
+long pop_bm_mpsc(struct bm_mpsc *bm_mpsc, struct bm_pocket **bm_pockets, long n_pkt);
+
+struct free_bm_mpsc {
+	freeing_func *ffunc;
+};
+
+int free_bm_mpsc(struct bm_mpsc **_bm_mpsc, struct free_bm_mpsc va_list);
+
+#define free_bm_mpsc(_bm_mpsc, ...) (free_bm_mpsc)(_bm_mpsc, \
+		(struct free_bm_mpsc) {.ffunc = bm_free, __VA_ARGS__})
+
+/* mmap.c */
+
+/* A zero page follows the mapped file, so bm_data{}->data is NUL-terminated for the str functions */
+
+struct map_bm_data {
+	int private;
+	int populate;
+	int sequential;
+	int willneed;
+	int hugepage;
+};
+
+struct bm_data* map_bm_data(char *path, struct map_bm_data va_list);
+
+#define map_bm_data(path, ...) (map_bm_data)(path, (struct map_bm_data) {.private = 0, \
+		.populate = 0, .sequential = 1, .willneed = 1, .hugepage = 1, __VA_ARGS__})
+
+int bm_munmap(void *mem);
+
+int unmap_bm_data(struct bm_data **_bm_data);
+
+/* map.c */
+
+struct create_bm_map {
+	long n_entry;
+	int nocase;
+	freeing_func *ffunc;
+};
+
+struct bm_map* create_bm_map(struct create_bm_map va_list);
+
+#define create_bm_map(...) (create_bm_map)((struct create_bm_map) {.n_entry = 0, \
+		.nocase = 0, .ffunc = bm_free, __VA_ARGS__})
+
+int reserve_bm_map(struct bm_map *bm_map, long n_entry);
+
+int put_bm_map(struct bm_map *bm_map, struct bm_data *key, struct bm_data *value);
+
+int fill_bm_map(struct bm_map *bm_map, struct bm_data *keys, struct bm_data *values, long n_entry);
+
+struct bm_data* get_bm_map(struct bm_map *bm_map, struct bm_data *key);
+
+int delete_bm_map(struct bm_map *bm_map, struct bm_data *key);
+
+int next_bm_map(struct bm_map *bm_map, long *iter, struct bm_data **key, struct bm_data **value);
+
+int free_bm_map(struct bm_map **_bm_map);
+
+/* reclaim.c */
+
+struct bm_reclaimer* create_bm_reclaimer();
+
+struct reclaim_bm_bag {
+	freeing_func *ffunc;
+	batch_freeing_func *bfunc;
+};
+
+int reclaim_bm_bag(struct bm_reclaimer *bm_reclaimer, struct bm_bag **_bm_bag, \
+		struct reclaim_bm_bag va_list);
+
+#define reclaim_bm_bag(bm_reclaimer, _bm_bag, ...) (reclaim_bm_bag)(bm_reclaimer, _bm_bag, \
+		(struct reclaim_bm_bag) {.ffunc = bm_free, .bfunc = NULL, __VA_ARGS__})
+
+int free_bm_reclaimer(struct bm_reclaimer **_bm_reclaimer);
+
+/* bitstream.c */
+
+struct create_bm_bitstream {
+	long offset;	// In bits
+	int write;
+};
+
+struct bm_bitstream* create_bm_bitstream(struct bm_data *bm_data, struct create_bm_bitstream va_list);
+
+#define create_bm_bitstream(bm_data, ...) (create_bm_bitstream)(bm_data, \
+		(struct create_bm_bitstream) {.offset = 0, .write = 0, __VA_ARGS__})
+
+int read_bm_bitstream(struct bm_bitstream *bm_bitstream, int n_bit, uint64_t *value);
+
+int peek_bm_bitstream(struct bm_bitstream *bm_bitstream, int n_bit, uint64_t *value);
+
+int write_bm_bitstream(struct bm_bitstream *bm_bitstream, uint64_t value, int n_bit);
+
+int flush_bm_bitstream(struct bm_bitstream *bm_bitstream);
+
+int align_bm_bitstream(struct bm_bitstream *bm_bitstream);
+
+long tell_bm_bitstream(struct bm_bitstream *bm_bitstream);
+
+int free_bm_bitstream(struct bm_bitstream **_bm_bitstream);
+
+/* idpool.c */
+
+struct bm_idpool* create_bm_idpool(long n_id);
+
+long alloc_bm_idpool(struct bm_idpool *bm_idpool);	// -1 when exhausted
+
+int release_bm_idpool(struct bm_idpool *bm_idpool, long id);
+
+int free_bm_idpool(struct bm_idpool **_bm_idpool);
+
+/* rank_select.c */
+
+struct bm_rank* create_bm_rank(void* bit_array, unsigned long n_bit);
+
+unsigned long rank_bm_rank(struct bm_rank *bm_rank, unsigned long pos);	// Set bits in [0, pos)
+
+long select_bm_rank(struct bm_rank *bm_rank, unsigned long k);	// Position of the k-th set bit, from 0, or -1
+
+int free_bm_rank(struct bm_rank **_bm_rank);
+
+/* roaring.c */
+
+struct bm_roaring* create_bm_roaring();
+
+int set_bm_roaring(struct bm_roaring *bm_roaring, uint32_t value);
+
+int clear_bm_roaring(struct bm_roaring *bm_roaring, uint32_t value);
+
+bit get_bm_roaring(struct bm_roaring *bm_roaring, uint32_t value);
+
+uint64_t count_bm_roaring(struct bm_roaring *bm_roaring);
+
+int next_bm_roaring(struct bm_roaring *bm_roaring, long *iter, uint32_t *value);
+
+uint32_t roaring_to_int(struct bm_roaring *bm_roaring, uint32_t bit_start, unsigned int _bit_count);
+
+int optimize_bm_roaring(struct bm_roaring *bm_roaring);
+
+struct bm_roaring* or_bm_roaring(struct bm_roaring *a, struct bm_roaring *b);
+
+struct bm_roaring* and_bm_roaring(struct bm_roaring *a, struct bm_roaring *b);
+
+struct bm_data* serialize_bm_roaring(struct bm_roaring *bm_roaring);
+
+struct bm_roaring* deserialize_bm_roaring(struct bm_data *bm_data);
+
+int free_bm_roaring(struct bm_roaring **_bm_roaring);
+
+/* packed.c */
+
+struct create_bm_packed {
+	long n_elem;
+};
+
+struct bm_packed* create_bm_packed(int width, struct create_bm_packed va_list);
+
+#define create_bm_packed(width, ...) (create_bm_packed)(width, \
+		(struct create_bm_packed) {.n_elem = 0, __VA_ARGS__})
+
+int reserve_bm_packed(struct bm_packed *bm_packed, long n_elem);
+
+uint64_t get_bm_packed(struct bm_packed *bm_packed, long at);
+
+int set_bm_packed(struct bm_packed *bm_packed, long at, uint64_t value);
+
+int append_bm_packed(struct bm_packed *bm_packed, uint64_t value);
+
+int unpack_bm_packed(struct bm_packed *bm_packed, long at, long n, uint64_t *values);
+
+int unpack32_bm_packed(struct bm_packed *bm_packed, long at, long n, uint32_t *values);	// width <= 32
+
+int pack_bm_packed(struct bm_packed *bm_packed, long at, uint64_t *values, long n);
+
+int pack32_bm_packed(struct bm_packed *bm_packed, long at, uint32_t *values, long n);
+
+int free_bm_packed(struct bm_packed **_bm_packed);
+
+/* frame.c */
+
+#define BM_FRAME_VARINT 0	// LEB128 length header, otherwise .header is a big-endian width of 1, 2, 4 or 8
+
+struct parse_bm_frames {
+	int header;
+	long max_size;
+	long *consumed;
+};
+
+int parse_bm_frames(struct bm_data *bm_data, struct bm_data *frames, long *n_frame, \
+		struct parse_bm_frames va_list);
+
+#define parse_bm_frames(bm_data, frames, n_frame, ...) (parse_bm_frames)(bm_data, frames, n_frame, \
+		(struct parse_bm_frames) {.header = BM_FRAME_VARINT, .max_size = LONG_MAX, .consumed = NULL, __VA_ARGS__})
+
+struct parse_bm_bag_frames {
+	int header;
+	long max_size;
+	long *consumed;
+	long offset;
+	struct bm_buf *scratch;	// Gathers payloads split across bm_pocket{}
+};
+
+int parse_bm_bag_frames(struct bm_bag *bm_bag, struct bm_data *frames, long *n_frame, \
+		struct parse_bm_bag_frames va_list);
+
+#define parse_bm_bag_frames(bm_bag, frames, n_frame, ...) (parse_bm_bag_frames)(bm_bag, frames, n_frame, \
+		(struct parse_bm_bag_frames) {.header = BM_FRAME_VARINT, .max_size = LONG_MAX, .consumed = NULL, \
+		.offset = 0, .scratch = NULL, __VA_ARGS__})
+
+struct encode_bm_frames {
+	int header;
+};
+
+int encode_bm_frames(struct bm_bag *bm_bag, struct bm_data *frames, long n_frame, struct encode_bm_frames va_list);
+
+#define encode_bm_frames(bm_bag, frames, n_frame, ...) (encode_bm_frames)(bm_bag, frames, n_frame, \
+		(struct encode_bm_frames) {.header = BM_FRAME_VARINT, __VA_ARGS__})
+
+/* checksum.c */
+
+uint32_t update_crc32c(uint32_t crc, void *data, long size);	// Continues crc, start from 0
+
+struct crc32c_bm_data {
+	uint32_t crc;
+};
+
+uint32_t crc32c_bm_data(struct bm_data *bm_data, struct crc32c_bm_data va_list);
+
+#define crc32c_bm_data(bm_data, ...) (crc32c_bm_data)(bm_data, (struct crc32c_bm_data) {.crc = 0, __VA_ARGS__})
+
+struct crc32c_bm_bag {
+	uint32_t crc;
+};
+
+uint32_t crc32c_bm_bag(struct bm_bag *bm_bag, struct crc32c_bm_bag va_list);
+
+#define crc32c_bm_bag(bm_bag, ...) (crc32c_bm_bag)(bm_bag, (struct crc32c_bm_bag) {.crc = 0, __VA_ARGS__})
+
+struct init_bm_hash {
+	uint64_t seed;
+};
+
+int init_bm_hash(struct bm_hash *bm_hash, struct init_bm_hash va_list);
+
+#define init_bm_hash(bm_hash, ...) (init_bm_hash)(bm_hash, (struct init_bm_hash) {.seed = 0, __VA_ARGS__})
+
+int update_bm_hash(struct bm_hash *bm_hash, void *data, long size);
+
+uint64_t digest_bm_hash(struct bm_hash *bm_hash);
+
+struct hash_bm_data {
+	uint64_t seed;
+};
+
+uint64_t hash_bm_data(struct bm_data *bm_data, struct hash_bm_data va_list);
+
+#define hash_bm_data(bm_data, ...) (hash_bm_data)(bm_data, (struct hash_bm_data) {.seed = 0, __VA_ARGS__})
+
+struct hash_bm_bag {
+	uint64_t seed;
+};
+
+uint64_t hash_bm_bag(struct bm_bag *bm_bag, struct hash_bm_bag va_list);
+
+#define hash_bm_bag(bm_bag, ...) (hash_bm_bag)(bm_bag, (struct hash_bm_bag) {.seed = 0, __VA_ARGS__})
+
+/* lz.c */
+
+struct create_bm_lz {
+	int decode;
+	long block_size;
+};
+
+struct bm_lz* create_bm_lz(struct create_bm_lz va_list);
+
+#define create_bm_lz(...) (create_bm_lz)((struct create_bm_lz) {.decode = 0, .block_size = BM_LZ_BLOCK, __VA_ARGS__})
+
+struct compress_bm_lz {
+	int flush;	// Emit the partial block too
+};
+
+int compress_bm_lz(struct bm_lz *bm_lz, struct bm_data *bm_data, struct bm_bag *dst, struct compress_bm_lz va_list);
+
+#define compress_bm_lz(bm_lz, bm_data, dst, ...) (compress_bm_lz)(bm_lz, bm_data, dst, \
+		(struct compress_bm_lz) {.flush = 0, __VA_ARGS__})
+
+int compress_bm_lz_bag(struct bm_lz *bm_lz, struct bm_bag *src, struct bm_bag *dst, struct compress_bm_lz va_list);
+
+#define compress_bm_lz_bag(bm_lz, src, dst, ...) (compress_bm_lz_bag)(bm_lz, src, dst, \
+		(struct compress_bm_lz) {.flush = 0, __VA_ARGS__})
+
+struct decompress_bm_lz {
+	int flush;	// Input ends here, a partial block is an error
+};
+
+int decompress_bm_lz(struct bm_lz *bm_lz, struct bm_data *bm_data, struct bm_bag *dst, struct decompress_bm_lz va_list);
+
+#define decompress_bm_lz(bm_lz, bm_data, dst, ...) (decompress_bm_lz)(bm_lz, bm_data, dst, \
+		(struct decompress_bm_lz) {.flush = 0, __VA_ARGS__})
+
+int decompress_bm_lz_bag(struct bm_lz *bm_lz, struct bm_bag *src, struct bm_bag *dst, struct decompress_bm_lz va_list);
+
+#define decompress_bm_lz_bag(bm_lz, src, dst, ...) (decompress_bm_lz_bag)(bm_lz, src, dst, \
+		(struct decompress_bm_lz) {.flush = 0, __VA_ARGS__})
+
+int free_bm_lz(struct bm_lz **_bm_lz);
+
+/* http.c */
+
+int init_bm_http(struct bm_http *bm_http);
+
+struct parse_bm_http {
+	int response;
+	long max_head;
+};
+
+int parse_bm_http(struct bm_http *bm_http, struct bm_data *bm_data, struct bm_http_header *headers, \
+		long *n_header, struct parse_bm_http va_list);	// BM_ERROR_RETRY until the head is complete
+
+#define parse_bm_http(bm_http, bm_data, headers, n_header, ...) (parse_bm_http)(bm_http, bm_data, headers, \
+		n_header, (struct parse_bm_http) {.response = 0, .max_head = BM_HTTP_MAX_HEAD, __VA_ARGS__})
+
+struct parse_bm_http_bag {
+	int response;
+	long max_head;
+	long offset;
+	struct bm_buf *scratch;	// Gathers a head split across bm_pocket{}
+};
+
+int parse_bm_http_bag(struct bm_http *bm_http, struct bm_bag *bm_bag, struct bm_http_header *headers, \
+		long *n_header, struct parse_bm_http_bag va_list);
+
+#define parse_bm_http_bag(bm_http, bm_bag, headers, n_header, ...) (parse_bm_http_bag)(bm_http, bm_bag, headers, \
+		n_header, (struct parse_bm_http_bag) {.response = 0, .max_head = BM_HTTP_MAX_HEAD, .offset = 0, \
+		.scratch = NULL, __VA_ARGS__})
+
+/* encode.c */
+
+#define BM_BASE64 0
+#define BM_BASE64_URL 1	// RFC 4648 URL and filename safe alphabet
+#define BM_HEX 2
+
+long encoded_size(long size, int codec, int pad);
+
+long decoded_size(long size, int codec);
+
+struct encode_bm_data {
+	int codec;
+	int pad;
+	long offset;
+	long *written;
+};
+
+int encode_bm_data(struct bm_data *src, struct bm_data *dst, struct encode_bm_data va_list);	// Into dst{}->data at .offset
+
+#define encode_bm_data(src, dst, ...) (encode_bm_data)(src, dst, (struct encode_bm_data) {.codec = BM_BASE64, \
+		.pad = 1, .offset = 0, .written = NULL, __VA_ARGS__})
+
+struct decode_bm_data {
+	int codec;
+	long offset;
+	long *written;
+};
+
+int decode_bm_data(struct bm_data *src, struct bm_data *dst, struct decode_bm_data va_list);
+
+#define decode_bm_data(src, dst, ...) (decode_bm_data)(src, dst, (struct decode_bm_data) {.codec = BM_BASE64, \
+		.offset = 0, .written = NULL, __VA_ARGS__})
+
+struct init_bm_text {
+	int codec;
+	int decode;
+	int pad;
+};
+
+int init_bm_text(struct bm_text *bm_text, struct init_bm_text va_list);
+
+#define init_bm_text(bm_text, ...) (init_bm_text)(bm_text, (struct init_bm_text) {.codec = BM_BASE64, .decode = 0, \
+		.pad = 1, __VA_ARGS__})
+
+struct encode_bm_text {
+	int flush;	// Close the stream with the partial group
+};
+
+int encode_bm_text(struct bm_text *bm_text, struct bm_data *bm_data, struct bm_bag *dst, struct encode_bm_text va_list);
+
+#define encode_bm_text(bm_text, bm_data, dst, ...) (encode_bm_text)(bm_text, bm_data, dst, \
+		(struct encode_bm_text) {.flush = 0, __VA_ARGS__})
+
+int encode_bm_text_bag(struct bm_text *bm_text, struct bm_bag *src, struct bm_bag *dst, struct encode_bm_text va_list);
+
+#define encode_bm_text_bag(bm_text, src, dst, ...) (encode_bm_text_bag)(bm_text, src, dst, \
+		(struct encode_bm_text) {.flush = 0, __VA_ARGS__})
+
+struct decode_bm_text {
+	int flush;	// Input ends here, an incomplete group is an error
+};
+
+int decode_bm_text(struct bm_text *bm_text, struct bm_data *bm_data, struct bm_bag *dst, struct decode_bm_text va_list);
+
+#define decode_bm_text(bm_text, bm_data, dst, ...) (decode_bm_text)(bm_text, bm_data, dst, \
+		(struct decode_bm_text) {.flush = 0, __VA_ARGS__})
+
+int decode_bm_text_bag(struct bm_text *bm_text, struct bm_bag *src, struct bm_bag *dst, struct decode_bm_text va_list);
+
+#define decode_bm_text_bag(bm_text, src, dst, ...) (decode_bm_text_bag)(bm_text, src, dst, \
+		(struct decode_bm_text) {.flush = 0, __VA_ARGS__})
 
 /* str_functions.c */
 
@@ -186,6 +932,30 @@ char* scopy(struct bm_data* bm_data, char* seq_str, struct scopy va_list);
 #define scopy(bm_data, seq_str, ...) (scopy)(bm_data, seq_str, (struct scopy) {.update = NULL, \
 		.flags = set_flags(BM_SCOPY_DELIMIT), .max_copy = LONG_MAX, __VA_ARGS__})
 
+/* The _slice variants advance a bm_slice{} view instead of copying, the bytes stay in its bm_shared{} */
+
+struct sseek_slice {
+	struct bm_slice **update;
+	long max_seek;
+	struct bm_flags flags;
+};
+
+int sseek_slice(struct bm_slice *bm_slice, char *seq_str, struct sseek_slice va_list);
+
+#define sseek_slice(bm_slice, seq_str, ...) (sseek_slice)(bm_slice, seq_str, (struct sseek_slice) {.update = NULL, \
+		.max_seek = LONG_MAX, .flags = set_flags(BM_SSEEK_DELIMIT), __VA_ARGS__})
+
+struct scopy_slice {
+	struct bm_slice **update;
+	long max_copy;
+	struct bm_flags flags;
+};
+
+char* scopy_slice(struct bm_slice *bm_slice, char *seq_str, struct scopy_slice va_list);
+
+#define scopy_slice(bm_slice, seq_str, ...) (scopy_slice)(bm_slice, seq_str, (struct scopy_slice) {.update = NULL, \
+		.flags = set_flags(BM_SCOPY_DELIMIT), .max_copy = LONG_MAX, __VA_ARGS__})
+
 char* bm_strappend(char *first, ...);
 
 #define strappend(...) bm_strappend(__VA_ARGS__ __VA_OPT__(,) NULL)
@@ -204,12 +974,78 @@ int assign_bit(void* bit_array, unsigned long bit_pos, bit bit_val);
 
 bit get_bit(void* bit_array, unsigned long bit_pos);
 
+bit test_and_set_bit(void* bit_array, unsigned long bit_pos);	// Atomic, returns the old bit
+
+bit test_and_clear_bit(void* bit_array, unsigned long bit_pos);
+
+bit fetch_toggle_bit(void* bit_array, unsigned long bit_pos);
+
+bit load_bit(void* bit_array, unsigned long bit_pos);
+
 uint32_t bits_to_int(bit* bits, unsigned int _bit_count);
 
 uint32_t bitarray_to_int(void* bit_array, unsigned long bit_start, unsigned int _bit_count);
 
 int int_to_bitarray(uint32_t value, void* bit_array, unsigned long bit_start, unsigned int _bit_count);
 
+int set_bit_range(void* bit_array, unsigned long bit_start, unsigned long bit_count);
+
+int clear_bit_range(void* bit_array, unsigned long bit_start, unsigned long bit_count);
+
+int toggle_bit_range(void* bit_array, unsigned long bit_start, unsigned long bit_count);
+
+unsigned long count_bit_range(void* bit_array, unsigned long bit_start, unsigned long bit_count);
+
+long next_set_bit(void* bit_array, unsigned long bit_pos, unsigned long bit_end);	// -1 if none
+
+long next_clear_bit(void* bit_array, unsigned long bit_pos, unsigned long bit_end);	// -1 if none
+
+int and_bitarray(void* dst, void* src, unsigned long bit_count);
+
+int or_bitarray(void* dst, void* src, unsigned long bit_count);
+
+int xor_bitarray(void* dst, void* src, unsigned long bit_count);
+
+int andnot_bitarray(void* dst, void* src, unsigned long bit_count);	// dst & ~src
+
+/* varint.c */
+
+static inline uint64_t int_to_zigzag(int64_t value) {
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t zigzag_to_int(uint64_t value) {
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+int varint_size(uint64_t value);
+
+int int_to_varint(uint64_t value, void* bytes);	// LEB128, returns the bytes written (up to 10)
+
+int varint_to_int(void* bytes, long avail, uint64_t* value);	// Bytes read, 0 if incomplete, -1 if malformed
+
+struct encode_bm_varints {
+	long offset;
+	long *consumed;
+	int zigzag;	// values[] holds int64_t
+};
+
+int encode_bm_varints(struct bm_data *bm_data, uint64_t *values, long *n_value, struct encode_bm_varints va_list);
+
+#define encode_bm_varints(bm_data, values, n_value, ...) (encode_bm_varints)(bm_data, values, n_value, \
+		(struct encode_bm_varints) {.offset = 0, .consumed = NULL, .zigzag = 0, __VA_ARGS__})
+
+struct decode_bm_varints {
+	long offset;
+	long *consumed;
+	int zigzag;
+};
+
+int decode_bm_varints(struct bm_data *bm_data, uint64_t *values, long *n_value, struct decode_bm_varints va_list);
+
+#define decode_bm_varints(bm_data, values, n_value, ...) (decode_bm_varints)(bm_data, values, n_value, \
+		(struct decode_bm_varints) {.offset = 0, .consumed = NULL, .zigzag = 0, __VA_ARGS__})
+
 /* socket.c */
 
 struct bm_socket_write {
@@ -217,23 +1053,41 @@ struct bm_socket_write {
 	struct bm_flags flags;
 	long io_timeout;
 	sigset_t *sigmask;
+	uint32_t *crc32c;	// Updated with the bytes transferred
 };
 
 int bm_socket_write(int sockfd, struct bm_data *bm_data, struct bm_socket_write va_list);
 
 #define bm_socket_write(sockfd, bm_data, ...) (bm_socket_write)(sockfd, bm_data, (struct bm_socket_write) \
-		{.status = NULL, .flags = set_flags(BM_MODE_AUTO_RETRY), .io_timeout = -1, .sigmask = NULL, __VA_ARGS__})
+		{.status = NULL, .flags = set_flags(BM_MODE_AUTO_RETRY), .io_timeout = -1, .sigmask = NULL, \
+		.crc32c = NULL, __VA_ARGS__})
+
+struct bm_socket_write_bag {
+	long *status;
+	struct bm_flags flags;
+	long io_timeout;
+	sigset_t *sigmask;
+	uint32_t *crc32c;	// Updated with the bytes transferred
+};
+
+int bm_socket_write_bag(int sockfd, struct bm_bag *bm_bag, struct bm_socket_write_bag va_list);
+
+#define bm_socket_write_bag(sockfd, bm_bag, ...) (bm_socket_write_bag)(sockfd, bm_bag, (struct bm_socket_write_bag) \
+		{.status = NULL, .flags = set_flags(BM_MODE_AUTO_RETRY), .io_timeout = -1, .sigmask = NULL, \
+		.crc32c = NULL, __VA_ARGS__})
 
 struct bm_socket_read {
 	long *status;
 	struct bm_flags flags;
 	long io_timeout;
 	sigset_t *sigmask;
+	uint32_t *crc32c;	// Updated with the bytes transferred
 };
 
 int bm_socket_read(int sockfd, struct bm_data *bm_data, struct bm_socket_read va_list);
 
 #define bm_socket_read(sockfd, bm_data, ...) (bm_socket_read)(sockfd, bm_data, (struct bm_socket_read) \
-		{.status = NULL, .flags = set_flags(), .io_timeout = -1, .sigmask = NULL, __VA_ARGS__})
+		{.status = NULL, .flags = set_flags(), .io_timeout = -1, .sigmask = NULL, \
+		.crc32c = NULL, __VA_ARGS__})
 
 #endif
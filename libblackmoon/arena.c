@@ -0,0 +1,125 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#define BM_ARENA_ALIGN 16
+
+struct bm_slab {
+	struct bm_slab *next;
+	long size;
+	long used;
+	long pad;
+	char data[];
+};
+
+struct bm_arena* (create_bm_arena)(struct create_bm_arena va_list) {
+	if (va_list.slab_size <= 0)
+		return NULL;
+
+	struct bm_arena *bm_arena = calloc(1, sizeof(struct bm_arena));
+
+	if (bm_arena == NULL)
+		return NULL;
+
+	bm_arena->slab_size = (va_list.slab_size + BM_ARENA_ALIGN - 1) & ~((long) BM_ARENA_ALIGN - 1);
+
+	return bm_arena;
+}
+
+static struct bm_slab* create_bm_slab(long slab_size) {
+	struct bm_slab *bm_slab = malloc(sizeof(struct bm_slab) + slab_size);
+
+	if (bm_slab == NULL)
+		return NULL;
+
+	bm_slab->next = NULL;
+	bm_slab->size = slab_size;
+	bm_slab->used = 0;
+
+	return bm_slab;
+}
+
+void* carve_bm_arena(struct bm_arena *bm_arena, long carve_size) {
+	if (bm_arena == NULL || carve_size <= 0)
+		return NULL;
+
+	carve_size = (carve_size + BM_ARENA_ALIGN - 1) & ~((long) BM_ARENA_ALIGN - 1);
+
+	/* Oversized requests get a dedicated bm_slab{}, kept behind the current one */
+
+	if (carve_size > bm_arena->slab_size / 2) {
+		struct bm_slab *bm_slab = create_bm_slab(carve_size);
+
+		if (bm_slab == NULL)
+			return NULL;
+
+		bm_slab->used = carve_size;
+
+		if (bm_arena->slab == NULL)
+			bm_arena->slab = bm_slab;
+		else {
+			bm_slab->next = bm_arena->slab->next;
+			bm_arena->slab->next = bm_slab;
+		}
+
+		bm_arena->n_slab = bm_arena->n_slab + 1;
+
+		return bm_slab->data;
+	}
+
+	/* Carve from the current bm_slab{}, start a new one if exhausted */
+
+	struct bm_slab *bm_slab = bm_arena->slab;
+
+	if (bm_slab == NULL || bm_slab->size - bm_slab->used < carve_size) {
+		bm_slab = create_bm_slab(bm_arena->slab_size);
+
+		if (bm_slab == NULL)
+			return NULL;
+
+		bm_slab->next = bm_arena->slab;
+		bm_arena->slab = bm_slab;
+		bm_arena->n_slab = bm_arena->n_slab + 1;
+	}
+
+	void *mem = bm_slab->data + bm_slab->used;
+	bm_slab->used = bm_slab->used + carve_size;
+
+	return mem;
+}
+
+int free_bm_arena(struct bm_arena **_bm_arena) {
+	if (_bm_arena == NULL || *_bm_arena == NULL)
+		return BM_ERROR_INVAL;
+
+	/* Release all the bm_slab{} in one sweep */
+
+	struct bm_slab *bm_slab = NULL, *next = NULL;
+
+	for (bm_slab = (*_bm_arena)->slab; bm_slab != NULL; bm_slab = next) {
+		next = bm_slab->next;
+		free(bm_slab);
+	}
+
+	free(*_bm_arena);
+	*_bm_arena = NULL;
+
+	return BM_ERROR_NONE;
+}
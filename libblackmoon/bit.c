@@ -20,6 +20,11 @@
 #include <string.h>
 #include <stdint.h> 
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BM_BIT_X86
+#endif
+
 int set_bit(void* bit_array, unsigned long bit_pos) {
 	unsigned long q = bit_pos / 8;
 	unsigned long r = bit_pos % 8;
@@ -79,6 +84,32 @@ bit get_bit(void* bit_array, unsigned long bit_pos) {
 	return 0;
 }
 
+/* Atomic variants, safe on a bit array shared between threads */
+
+bit test_and_set_bit(void* bit_array, unsigned long bit_pos) {
+	uint8_t mask = 0b10000000 >> (bit_pos % 8);
+
+	return (__atomic_fetch_or((uint8_t*) bit_array + bit_pos / 8, mask, __ATOMIC_ACQ_REL) & mask) ? 1 : 0;
+}
+
+bit test_and_clear_bit(void* bit_array, unsigned long bit_pos) {
+	uint8_t mask = 0b10000000 >> (bit_pos % 8);
+
+	return (__atomic_fetch_and((uint8_t*) bit_array + bit_pos / 8, (uint8_t) ~mask, __ATOMIC_ACQ_REL) & mask) ? 1 : 0;
+}
+
+bit fetch_toggle_bit(void* bit_array, unsigned long bit_pos) {
+	uint8_t mask = 0b10000000 >> (bit_pos % 8);
+
+	return (__atomic_fetch_xor((uint8_t*) bit_array + bit_pos / 8, mask, __ATOMIC_ACQ_REL) & mask) ? 1 : 0;
+}
+
+bit load_bit(void* bit_array, unsigned long bit_pos) {
+	uint8_t mask = 0b10000000 >> (bit_pos % 8);
+
+	return (__atomic_load_n((uint8_t*) bit_array + bit_pos / 8, __ATOMIC_ACQUIRE) & mask) ? 1 : 0;
+}
+
 uint32_t bits_to_int(bit* bits, unsigned int _bit_count) {
 	uint32_t value, mask = 0b1;
 	memset((void*) &value, 0, sizeof(value));
@@ -95,34 +126,405 @@ uint32_t bits_to_int(bit* bits, unsigned int _bit_count) {
 	return value;
 }
 
+/* Load and store up to 8 bytes as the top bytes of a big-endian word */
+
+static inline uint64_t load_be_bytes(const uint8_t *bytes, unsigned int n_byte) {
+	uint64_t word = 0;
+
+	switch (n_byte) {	// Constant sized copies compile to plain loads
+	case 1: memcpy(&word, bytes, 1); break;
+	case 2: memcpy(&word, bytes, 2); break;
+	case 3: memcpy(&word, bytes, 3); break;
+	case 4: memcpy(&word, bytes, 4); break;
+	case 5: memcpy(&word, bytes, 5); break;
+	case 6: memcpy(&word, bytes, 6); break;
+	case 7: memcpy(&word, bytes, 7); break;
+	default: memcpy(&word, bytes, 8); break;
+	}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	return word;
+}
+
+static inline void store_be_bytes(uint8_t *bytes, uint64_t word, unsigned int n_byte) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	switch (n_byte) {
+	case 1: memcpy(bytes, &word, 1); break;
+	case 2: memcpy(bytes, &word, 2); break;
+	case 3: memcpy(bytes, &word, 3); break;
+	case 4: memcpy(bytes, &word, 4); break;
+	case 5: memcpy(bytes, &word, 5); break;
+	case 6: memcpy(bytes, &word, 6); break;
+	case 7: memcpy(bytes, &word, 7); break;
+	default: memcpy(bytes, &word, 8); break;
+	}
+}
+
+static inline uint64_t low_bits(uint64_t value, unsigned int bit_count) {
+#ifdef __BMI2__
+	return _bzhi_u64(value, bit_count);
+#else
+	return bit_count >= 64 ? value : value & ((1ULL << bit_count) - 1);
+#endif
+}
+
 uint32_t bitarray_to_int(void* bit_array, unsigned long bit_start, unsigned int _bit_count) {
-	uint32_t value, mask = 0b1;
-	memset((void*) &value, 0, sizeof(value));
+	unsigned int bit_count = _bit_count < sizeof(uint32_t) * 8 ? \
+				 _bit_count : sizeof(uint32_t) * 8;
+
+	if (bit_count == 0)
+		return 0;
 
+	/* Touch only the bytes spanned by the field, at most five */
+
+	unsigned int r = bit_start % 8;
+	uint64_t word = load_be_bytes((uint8_t*) bit_array + bit_start / 8, (r + bit_count + 7) / 8);
+
+	return (uint32_t) ((word << r) >> (64 - bit_count));
+}
+
+int int_to_bitarray(uint32_t value, void* bit_array, unsigned long bit_start, unsigned int _bit_count) {
 	unsigned int bit_count = _bit_count < sizeof(value) * 8 ? \
 				 _bit_count : sizeof(value) * 8;
 
-	for (unsigned int cur_bit = 0; cur_bit < bit_count; cur_bit++) {
-		if (get_bit(bit_array, bit_start + cur_bit) == 1) {
-			value = value | (mask << (bit_count - cur_bit - 1));
+	if (bit_count == 0)
+		return BM_ERROR_NONE;
+
+	/* Read-modify-write the spanned bytes with the field in place */
+
+	unsigned int r = bit_start % 8, n_byte = (r + bit_count + 7) / 8;
+	unsigned int shift = 64 - r - bit_count;
+	uint8_t *bytes = (uint8_t*) bit_array + bit_start / 8;
+
+	uint64_t mask = low_bits(~0ULL, bit_count) << shift;
+	uint64_t word = load_be_bytes(bytes, n_byte);
+
+	word = (word & ~mask) | (low_bits(value, bit_count) << shift);
+
+	store_be_bytes(bytes, word, n_byte);
+
+	return BM_ERROR_NONE;
+}
+
+/* Bulk operations over bit ranges, 64-bit words with AVX2 kernels where supported */
+
+#define BM_BIT_SET 0
+#define BM_BIT_CLEAR 1
+#define BM_BIT_TOGGLE 2
+#define BM_BIT_AND 3
+#define BM_BIT_OR 4
+#define BM_BIT_XOR 5
+#define BM_BIT_ANDNOT 6
+
+static inline int bm_bit_avx2() {
+#ifdef BM_BIT_X86
+	return __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+static inline uint8_t apply_byte(uint8_t byte, uint8_t mask, int op) {
+	if (op == BM_BIT_SET)
+		return byte | mask;
+	else if (op == BM_BIT_CLEAR)
+		return byte & ~mask;
+
+	return byte ^ mask;
+}
+
+static int apply_bit_range(uint8_t *bytes, unsigned long bit_start, unsigned long bit_count, int op) {
+	if (bytes == NULL)
+		return BM_ERROR_INVAL;
+
+	if (bit_count == 0)
+		return BM_ERROR_NONE;
+
+	bytes = bytes + bit_start / 8;
+	unsigned int r = bit_start % 8;
+
+	/* Range within a single byte */
+
+	if (r + bit_count <= 8) {
+		*bytes = apply_byte(*bytes, (0xFF >> r) & ~(0xFF >> (r + bit_count)), op);
+		return BM_ERROR_NONE;
+	}
+
+	/* Partial head byte, whole middle bytes, partial tail byte */
+
+	if (r != 0) {
+		*bytes = apply_byte(*bytes, 0xFF >> r, op);
+		bytes = bytes + 1;
+		bit_count = bit_count - (8 - r);
+	}
+
+	unsigned long n_byte = bit_count / 8;
+
+	if (op == BM_BIT_SET)
+		memset(bytes, 0xFF, n_byte);
+	else if (op == BM_BIT_CLEAR)
+		memset(bytes, 0, n_byte);
+	else {
+		unsigned long i = 0;
+		uint64_t word;
+
+		for ( ; i + 8 <= n_byte; i = i + 8) {
+			memcpy(&word, bytes + i, 8);
+			word = ~word;
+			memcpy(bytes + i, &word, 8);
 		}
+
+		for ( ; i < n_byte; i++)
+			bytes[i] = ~bytes[i];
 	}
 
-	return value;
+	if (bit_count % 8 != 0)
+		bytes[n_byte] = apply_byte(bytes[n_byte], ~(0xFF >> (bit_count % 8)), op);
+
+	return BM_ERROR_NONE;
 }
 
-int int_to_bitarray(uint32_t value, void* bit_array, unsigned long bit_start, unsigned int _bit_count) {
-	unsigned int bit_count = _bit_count < sizeof(value) * 8 ? \
-				 _bit_count : sizeof(value) * 8;
+int set_bit_range(void* bit_array, unsigned long bit_start, unsigned long bit_count) {
+	return apply_bit_range(bit_array, bit_start, bit_count, BM_BIT_SET);
+}
 
-	uint32_t mask = 0b1 << (bit_count - 1);
+int clear_bit_range(void* bit_array, unsigned long bit_start, unsigned long bit_count) {
+	return apply_bit_range(bit_array, bit_start, bit_count, BM_BIT_CLEAR);
+}
 
-	for (unsigned int cur_bit = 0; cur_bit < bit_count; cur_bit++) {
-		if (value & (mask >> cur_bit))
-			set_bit(bit_array, bit_start + cur_bit);
+int toggle_bit_range(void* bit_array, unsigned long bit_start, unsigned long bit_count) {
+	return apply_bit_range(bit_array, bit_start, bit_count, BM_BIT_TOGGLE);
+}
+
+#ifdef BM_BIT_X86
+__attribute__((target("avx2")))
+static unsigned long count_bytes_avx2(const uint8_t *bytes, unsigned long n_byte) {
+	/* Nibble lookup with vpshufb, byte sums folded into 64-bit lanes by vpsadbw */
+
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, \
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0F);
+	__m256i acc = _mm256_setzero_si256();
+
+	for (unsigned long i = 0; i < n_byte; i = i + 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) (bytes + i));
+		__m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)), \
+				_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+	}
+
+	return _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + \
+			_mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+}
+#endif
+
+static unsigned long count_bytes(const uint8_t *bytes, unsigned long n_byte) {
+	unsigned long count = 0, i = 0;
+	uint64_t word;
+
+#ifdef BM_BIT_X86
+	if (n_byte >= 256 && bm_bit_avx2()) {
+		i = n_byte & ~31UL;
+		count = count_bytes_avx2(bytes, i);
+	}
+#endif
+
+	for ( ; i + 8 <= n_byte; i = i + 8) {
+		memcpy(&word, bytes + i, 8);
+		count = count + __builtin_popcountll(word);
+	}
+
+	for ( ; i < n_byte; i++)
+		count = count + __builtin_popcount(bytes[i]);
+
+	return count;
+}
+
+unsigned long count_bit_range(void* bit_array, unsigned long bit_start, unsigned long bit_count) {
+	if (bit_array == NULL || bit_count == 0)
+		return 0;
+
+	uint8_t *bytes = (uint8_t*) bit_array + bit_start / 8;
+	unsigned int r = bit_start % 8;
+
+	if (r + bit_count <= 8)
+		return __builtin_popcount(*bytes & (0xFF >> r) & ~(0xFF >> (r + bit_count)));
+
+	unsigned long count = 0;
+
+	if (r != 0) {
+		count = __builtin_popcount(*bytes & (0xFF >> r));
+		bytes = bytes + 1;
+		bit_count = bit_count - (8 - r);
+	}
+
+	count = count + count_bytes(bytes, bit_count / 8);
+
+	if (bit_count % 8 != 0)
+		count = count + __builtin_popcount(bytes[bit_count / 8] & ~(0xFF >> (bit_count % 8)));
+
+	return count;
+}
+
+#ifdef BM_BIT_X86
+__attribute__((target("avx2")))
+static unsigned long skip_bytes_avx2(const uint8_t *bytes, unsigned long n_byte, uint8_t fill) {
+	/* Length of the leading run of 32 byte blocks made only of fill */
+
+	const __m256i ones = _mm256_set1_epi8((char) 0xFF);
+	unsigned long i = 0;
+
+	for ( ; i + 32 <= n_byte; i = i + 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) (bytes + i));
+
+		if (fill == 0 ? !_mm256_testz_si256(v, v) : !_mm256_testc_si256(v, ones))
+			break;
+	}
+
+	return i;
+}
+#endif
+
+static long next_bit(const uint8_t *bytes, unsigned long bit_pos, unsigned long bit_end, uint8_t fill) {
+	if (bytes == NULL || bit_pos >= bit_end)
+		return -1;
+
+	/* fill is the byte value being skipped: 0x00 to find a set bit, 0xFF to find a clear one */
+
+	unsigned long q = bit_pos / 8, end = (bit_end + 7) / 8, pos = 0;
+	uint64_t flip = fill == 0 ? 0 : ~0ULL, word;
+
+	uint8_t byte = (bytes[q] ^ fill) & (0xFF >> (bit_pos % 8));
+	q = q + 1;
+
+	if (byte != 0) {
+		pos = (q - 1) * 8 + __builtin_clz(byte) - 24;
+		return pos < bit_end ? (long) pos : -1;
+	}
+
+#ifdef BM_BIT_X86
+	if (end - q >= 256 && bm_bit_avx2())
+		q = q + skip_bytes_avx2(bytes + q, end - q, fill);
+#endif
+
+	for ( ; q + 8 <= end; q = q + 8) {
+		memcpy(&word, bytes + q, 8);
+
+		if ((word ^ flip) == 0)
+			continue;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		word = __builtin_bswap64(word);
+#endif
+		pos = q * 8 + __builtin_clzll(word ^ flip);
+		return pos < bit_end ? (long) pos : -1;
+	}
+
+	for ( ; q < end; q++) {
+		if ((byte = bytes[q] ^ fill) != 0) {
+			pos = q * 8 + __builtin_clz(byte) - 24;
+			return pos < bit_end ? (long) pos : -1;
+		}
+	}
+
+	return -1;
+}
+
+long next_set_bit(void* bit_array, unsigned long bit_pos, unsigned long bit_end) {
+	return next_bit(bit_array, bit_pos, bit_end, 0x00);
+}
+
+long next_clear_bit(void* bit_array, unsigned long bit_pos, unsigned long bit_end) {
+	return next_bit(bit_array, bit_pos, bit_end, 0xFF);
+}
+
+static inline uint64_t combine_word(uint64_t a, uint64_t b, int op) {
+	if (op == BM_BIT_AND)
+		return a & b;
+	else if (op == BM_BIT_OR)
+		return a | b;
+	else if (op == BM_BIT_XOR)
+		return a ^ b;
+
+	return a & ~b;
+}
+
+#ifdef BM_BIT_X86
+__attribute__((target("avx2")))
+static unsigned long combine_bytes_avx2(uint8_t *dst, const uint8_t *src, unsigned long n_byte, int op) {
+	unsigned long i = 0;
+
+	for ( ; i + 32 <= n_byte; i = i + 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) (dst + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*) (src + i));
+
+		if (op == BM_BIT_AND)
+			a = _mm256_and_si256(a, b);
+		else if (op == BM_BIT_OR)
+			a = _mm256_or_si256(a, b);
+		else if (op == BM_BIT_XOR)
+			a = _mm256_xor_si256(a, b);
 		else
-			clear_bit(bit_array, bit_start + cur_bit);
+			a = _mm256_andnot_si256(b, a);
+
+		_mm256_storeu_si256((__m256i*) (dst + i), a);
+	}
+
+	return i;
+}
+#endif
+
+static int combine_bitarray(uint8_t *dst, const uint8_t *src, unsigned long bit_count, int op) {
+	if (dst == NULL || src == NULL)
+		return BM_ERROR_INVAL;
+
+	unsigned long n_byte = bit_count / 8, i = 0;
+	uint64_t a, b;
+
+#ifdef BM_BIT_X86
+	if (n_byte >= 64 && bm_bit_avx2())
+		i = combine_bytes_avx2(dst, src, n_byte, op);
+#endif
+
+	for ( ; i + 8 <= n_byte; i = i + 8) {
+		memcpy(&a, dst + i, 8);
+		memcpy(&b, src + i, 8);
+		a = combine_word(a, b, op);
+		memcpy(dst + i, &a, 8);
+	}
+
+	for ( ; i < n_byte; i++)
+		dst[i] = combine_word(dst[i], src[i], op);
+
+	/* Bits past bit_count in the last byte are left untouched */
+
+	if (bit_count % 8 != 0) {
+		uint8_t mask = ~(0xFF >> (bit_count % 8));
+		dst[n_byte] = (dst[n_byte] & ~mask) | (combine_word(dst[n_byte], src[n_byte], op) & mask);
 	}
 
 	return BM_ERROR_NONE;
 }
+
+int and_bitarray(void* dst, void* src, unsigned long bit_count) {
+	return combine_bitarray(dst, src, bit_count, BM_BIT_AND);
+}
+
+int or_bitarray(void* dst, void* src, unsigned long bit_count) {
+	return combine_bitarray(dst, src, bit_count, BM_BIT_OR);
+}
+
+int xor_bitarray(void* dst, void* src, unsigned long bit_count) {
+	return combine_bitarray(dst, src, bit_count, BM_BIT_XOR);
+}
+
+int andnot_bitarray(void* dst, void* src, unsigned long bit_count) {
+	return combine_bitarray(dst, src, bit_count, BM_BIT_ANDNOT);
+}
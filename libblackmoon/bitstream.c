@@ -0,0 +1,250 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+static inline uint64_t load_be64(const uint8_t *bytes) {
+	uint64_t word;
+
+	memcpy(&word, bytes, sizeof(word));
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	return word;
+}
+
+struct bm_bitstream* (create_bm_bitstream)(struct bm_data *bm_data, struct create_bm_bitstream va_list) {
+	if (bm_data == NULL || bm_data->size < 0 || va_list.offset < 0 || \
+			(bm_data->size > 0 && bm_data->data == NULL) || va_list.offset > bm_data->size * 8)
+		return NULL;
+
+	struct bm_bitstream *bm_bitstream = calloc(1, sizeof(struct bm_bitstream));
+
+	if (bm_bitstream == NULL)
+		return NULL;
+
+	bm_bitstream->bm_data = bm_data;
+	bm_bitstream->pos = va_list.offset / 8;
+	bm_bitstream->write = va_list.write;
+
+	int r = va_list.offset % 8;
+
+	if (r == 0)
+		return bm_bitstream;
+
+	/* Start mid byte: writer keeps the leading bits, reader drops them */
+
+	uint8_t lead = ((uint8_t*) bm_data->data)[bm_bitstream->pos];
+
+	if (va_list.write) {
+		bm_bitstream->acc = (uint64_t) (lead & ~(0xFF >> r)) << 56;
+		bm_bitstream->n_acc = r;
+	}
+	else {
+		bm_bitstream->acc = (uint64_t) lead << (56 + r);
+		bm_bitstream->n_acc = 8 - r;
+		bm_bitstream->pos = bm_bitstream->pos + 1;
+	}
+
+	return bm_bitstream;
+}
+
+/* Reader */
+
+static inline void fill_bm_bitstream(struct bm_bitstream *bm_bitstream) {
+	uint8_t *data = bm_bitstream->bm_data->data;
+	long left = bm_bitstream->bm_data->size - bm_bitstream->pos;
+
+	int n_byte = (64 - bm_bitstream->n_acc) / 8;
+
+	if (n_byte == 0)
+		return;
+
+	/* One big-endian load when a whole word remains, bytewise at the tail */
+
+	if (left >= 8) {
+		uint64_t word = load_be64(data + bm_bitstream->pos);
+
+		bm_bitstream->acc |= (word >> (64 - n_byte * 8)) << (64 - bm_bitstream->n_acc - n_byte * 8);
+		bm_bitstream->n_acc = bm_bitstream->n_acc + n_byte * 8;
+		bm_bitstream->pos = bm_bitstream->pos + n_byte;
+
+		return;
+	}
+
+	for ( ; n_byte > 0 && left > 0; n_byte--, left--) {
+		bm_bitstream->acc |= (uint64_t) data[bm_bitstream->pos] << (56 - bm_bitstream->n_acc);
+		bm_bitstream->n_acc = bm_bitstream->n_acc + 8;
+		bm_bitstream->pos = bm_bitstream->pos + 1;
+	}
+}
+
+static inline uint64_t take_bm_bitstream(struct bm_bitstream *bm_bitstream, int n_bit) {
+	if (bm_bitstream->n_acc < n_bit)
+		fill_bm_bitstream(bm_bitstream);
+
+	uint64_t value = bm_bitstream->acc >> (64 - n_bit);
+
+	bm_bitstream->acc = bm_bitstream->acc << n_bit;
+	bm_bitstream->n_acc = bm_bitstream->n_acc - n_bit;
+
+	return value;
+}
+
+int read_bm_bitstream(struct bm_bitstream *bm_bitstream, int n_bit, uint64_t *value) {
+	if (bm_bitstream == NULL || bm_bitstream->write || n_bit < 0 || n_bit > 64 || value == NULL)
+		return BM_ERROR_INVAL;
+
+	if (n_bit > (bm_bitstream->bm_data->size - bm_bitstream->pos) * 8 + bm_bitstream->n_acc)
+		return BM_ERROR_INVAL;
+
+	if (n_bit == 0) {
+		*value = 0;
+		return BM_ERROR_NONE;
+	}
+
+	/* A refill guarantees at least 57 cached bits, wider fields take two steps */
+
+	if (n_bit > 56) {
+		uint64_t hi = take_bm_bitstream(bm_bitstream, n_bit - 32);
+		*value = (hi << 32) | take_bm_bitstream(bm_bitstream, 32);
+	}
+	else
+		*value = take_bm_bitstream(bm_bitstream, n_bit);
+
+	return BM_ERROR_NONE;
+}
+
+int peek_bm_bitstream(struct bm_bitstream *bm_bitstream, int n_bit, uint64_t *value) {
+	if (bm_bitstream == NULL || bm_bitstream->write || n_bit < 0 || n_bit > 56 || value == NULL)
+		return BM_ERROR_INVAL;
+
+	if (n_bit > (bm_bitstream->bm_data->size - bm_bitstream->pos) * 8 + bm_bitstream->n_acc)
+		return BM_ERROR_INVAL;
+
+	if (bm_bitstream->n_acc < n_bit)
+		fill_bm_bitstream(bm_bitstream);
+
+	*value = n_bit == 0 ? 0 : bm_bitstream->acc >> (64 - n_bit);
+
+	return BM_ERROR_NONE;
+}
+
+/* Writer */
+
+static inline void spill_bm_bitstream(struct bm_bitstream *bm_bitstream) {
+	uint8_t *data = bm_bitstream->bm_data->data;
+
+	for ( ; bm_bitstream->n_acc >= 8; bm_bitstream->n_acc -= 8) {
+		data[bm_bitstream->pos] = bm_bitstream->acc >> 56;
+		bm_bitstream->acc = bm_bitstream->acc << 8;
+		bm_bitstream->pos = bm_bitstream->pos + 1;
+	}
+}
+
+static inline void put_bm_bitstream(struct bm_bitstream *bm_bitstream, uint64_t value, int n_bit) {
+	if (bm_bitstream->n_acc + n_bit > 64)
+		spill_bm_bitstream(bm_bitstream);
+
+	value = n_bit == 64 ? value : value & ((1ULL << n_bit) - 1);
+
+	bm_bitstream->acc |= value << (64 - bm_bitstream->n_acc - n_bit);
+	bm_bitstream->n_acc = bm_bitstream->n_acc + n_bit;
+}
+
+int write_bm_bitstream(struct bm_bitstream *bm_bitstream, uint64_t value, int n_bit) {
+	if (bm_bitstream == NULL || !bm_bitstream->write || n_bit < 0 || n_bit > 64)
+		return BM_ERROR_INVAL;
+
+	if (n_bit > (bm_bitstream->bm_data->size - bm_bitstream->pos) * 8 - bm_bitstream->n_acc)
+		return BM_ERROR_BUFFER_FULL;
+
+	if (n_bit == 0)
+		return BM_ERROR_NONE;
+
+	/* After a spill at most 7 bits are pending, so 32 bit steps always fit */
+
+	if (n_bit > 32) {
+		put_bm_bitstream(bm_bitstream, value >> 32, n_bit - 32);
+		put_bm_bitstream(bm_bitstream, value, 32);
+	}
+	else
+		put_bm_bitstream(bm_bitstream, value, n_bit);
+
+	return BM_ERROR_NONE;
+}
+
+int flush_bm_bitstream(struct bm_bitstream *bm_bitstream) {
+	if (bm_bitstream == NULL || !bm_bitstream->write)
+		return BM_ERROR_INVAL;
+
+	spill_bm_bitstream(bm_bitstream);
+
+	/* Merge the pending bits into the trailing byte, it is rewritten on the next spill */
+
+	if (bm_bitstream->n_acc > 0) {
+		uint8_t *byte = (uint8_t*) bm_bitstream->bm_data->data + bm_bitstream->pos;
+		*byte = (*byte & (0xFF >> bm_bitstream->n_acc)) | (bm_bitstream->acc >> 56);
+	}
+
+	return BM_ERROR_NONE;
+}
+
+/* Common */
+
+int align_bm_bitstream(struct bm_bitstream *bm_bitstream) {
+	if (bm_bitstream == NULL)
+		return BM_ERROR_INVAL;
+
+	int r = bm_bitstream->n_acc % 8;
+
+	if (r == 0)
+		return BM_ERROR_NONE;
+
+	if (bm_bitstream->write)
+		return write_bm_bitstream(bm_bitstream, 0, 8 - r);
+
+	bm_bitstream->acc = bm_bitstream->acc << r;
+	bm_bitstream->n_acc = bm_bitstream->n_acc - r;
+
+	return BM_ERROR_NONE;
+}
+
+long tell_bm_bitstream(struct bm_bitstream *bm_bitstream) {
+	if (bm_bitstream == NULL)
+		return -1;
+
+	return bm_bitstream->write ? bm_bitstream->pos * 8 + bm_bitstream->n_acc : \
+			bm_bitstream->pos * 8 - bm_bitstream->n_acc;
+}
+
+int free_bm_bitstream(struct bm_bitstream **_bm_bitstream) {
+	if (_bm_bitstream == NULL || *_bm_bitstream == NULL)
+		return BM_ERROR_INVAL;
+
+	if ((*_bm_bitstream)->write)
+		flush_bm_bitstream(*_bm_bitstream);
+
+	free(*_bm_bitstream);
+	*_bm_bitstream = NULL;
+
+	return BM_ERROR_NONE;
+}
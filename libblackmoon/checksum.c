@@ -0,0 +1,343 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BM_CHECKSUM_X86
+#endif
+
+#define BM_CRC32C_POLY 0x82F63B78	// Castagnoli, reflected
+#define BM_CRC32C_LONG 8192	// Lane lengths of the three way interleaved crc32 instruction
+#define BM_CRC32C_SHORT 256
+
+static inline uint64_t load_le64(const uint8_t *bytes) {
+	uint64_t word;
+
+	memcpy(&word, bytes, sizeof(word));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	return word;
+}
+
+/* Tables: slice-by-8 for the portable path, and operators appending LONG or SHORT zero bytes */
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec) {
+	uint32_t sum = 0;
+
+	for ( ; vec != 0; vec = vec >> 1, mat++) {
+		if (vec & 1)
+			sum = sum ^ *mat;
+	}
+
+	return sum;
+}
+
+static void gf2_square(uint32_t *square, const uint32_t *mat) {
+	for (int n = 0; n < 32; n++)
+		square[n] = gf2_times(mat, mat[n]);
+}
+
+static void crc32c_zeros(uint32_t zeros[4][256], long n_byte) {
+	uint32_t even[32], odd[32];
+
+	/* Operator for one zero bit, squared up to one zero byte, then by powers of two */
+
+	odd[0] = BM_CRC32C_POLY;
+
+	for (int n = 1; n < 32; n++)
+		odd[n] = 1U << (n - 1);
+
+	gf2_square(even, odd);
+	gf2_square(odd, even);
+	gf2_square(even, odd);	// One zero byte
+
+	uint32_t *op = even, *tmp = odd, acc[32];
+	int have = 0;
+
+	for ( ; n_byte != 0; n_byte = n_byte >> 1) {
+		if (n_byte & 1) {
+			if (have) {
+				uint32_t next[32];
+
+				for (int n = 0; n < 32; n++)
+					next[n] = gf2_times(op, acc[n]);
+
+				memcpy(acc, next, sizeof(acc));
+			}
+			else
+				memcpy(acc, op, sizeof(acc));
+
+			have = 1;
+		}
+
+		gf2_square(tmp, op);
+
+		uint32_t *swap = op;
+		op = tmp;
+		tmp = swap;
+	}
+
+	for (int n = 0; n < 256; n++) {
+		for (int k = 0; k < 4; k++)
+			zeros[k][n] = gf2_times(acc, (uint32_t) n << (8 * k));
+	}
+}
+
+static void init_crc32c() {
+	for (int n = 0; n < 256; n++) {
+		uint32_t crc = n;
+
+		for (int k = 0; k < 8; k++)
+			crc = crc & 1 ? (crc >> 1) ^ BM_CRC32C_POLY : crc >> 1;
+
+		crc32c_table[0][n] = crc;
+	}
+
+	for (int n = 0; n < 256; n++) {
+		for (int k = 1; k < 8; k++)
+			crc32c_table[k][n] = (crc32c_table[k - 1][n] >> 8) ^ crc32c_table[0][crc32c_table[k - 1][n] & 0xFF];
+	}
+
+	crc32c_zeros(crc32c_long, BM_CRC32C_LONG);
+	crc32c_zeros(crc32c_short, BM_CRC32C_SHORT);
+}
+
+static inline uint32_t crc32c_shift(uint32_t zeros[4][256], uint32_t crc) {
+	return zeros[0][crc & 0xFF] ^ zeros[1][(crc >> 8) & 0xFF] ^ zeros[2][(crc >> 16) & 0xFF] ^ zeros[3][crc >> 24];
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *bytes, long size) {
+	for ( ; size >= 8; size = size - 8, bytes = bytes + 8) {
+		uint64_t word = load_le64(bytes) ^ crc;
+
+		crc = crc32c_table[7][word & 0xFF] ^ crc32c_table[6][(word >> 8) & 0xFF] ^ \
+				crc32c_table[5][(word >> 16) & 0xFF] ^ crc32c_table[4][(word >> 24) & 0xFF] ^ \
+				crc32c_table[3][(word >> 32) & 0xFF] ^ crc32c_table[2][(word >> 40) & 0xFF] ^ \
+				crc32c_table[1][(word >> 48) & 0xFF] ^ crc32c_table[0][word >> 56];
+	}
+
+	for ( ; size > 0; size--, bytes++)
+		crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *bytes) & 0xFF];
+
+	return crc;
+}
+
+#if defined(BM_CHECKSUM_X86) && defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static inline uint64_t crc32c_lanes(uint64_t crc0, const uint8_t **bytes, long *size, long lane, \
+		uint32_t zeros[4][256]) {
+	/* Three independent lanes hide the crc32 latency, merged by appending zeros */
+
+	for ( ; *size >= 3 * lane; *size = *size - 3 * lane, *bytes = *bytes + 3 * lane) {
+		const uint8_t *in = *bytes;
+		uint64_t crc1 = 0, crc2 = 0;
+
+		for (long at = 0; at < lane; at = at + 8) {
+			crc0 = _mm_crc32_u64(crc0, load_le64(in + at));
+			crc1 = _mm_crc32_u64(crc1, load_le64(in + lane + at));
+			crc2 = _mm_crc32_u64(crc2, load_le64(in + 2 * lane + at));
+		}
+
+		crc0 = crc32c_shift(zeros, crc0) ^ crc1;
+		crc0 = crc32c_shift(zeros, crc0) ^ crc2;
+	}
+
+	return crc0;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *bytes, long size) {
+	uint64_t crc0 = crc32c_lanes(crc, &bytes, &size, BM_CRC32C_LONG, crc32c_long);
+	crc0 = crc32c_lanes(crc0, &bytes, &size, BM_CRC32C_SHORT, crc32c_short);
+
+	for ( ; size >= 8; size = size - 8, bytes = bytes + 8)
+		crc0 = _mm_crc32_u64(crc0, load_le64(bytes));
+
+	for ( ; size > 0; size--, bytes++)
+		crc0 = _mm_crc32_u8(crc0, *bytes);
+
+	return crc0;
+}
+#endif
+
+uint32_t update_crc32c(uint32_t crc, void *data, long size) {
+	if (data == NULL || size <= 0)
+		return crc;
+
+	pthread_once(&crc32c_once, init_crc32c);
+
+#if defined(BM_CHECKSUM_X86) && defined(__x86_64__)
+	if (__builtin_cpu_supports("sse4.2"))
+		return ~crc32c_hw(~crc, data, size);
+#endif
+
+	return ~crc32c_sw(~crc, data, size);
+}
+
+uint32_t (crc32c_bm_data)(struct bm_data *bm_data, struct crc32c_bm_data va_list) {
+	if (bm_data == NULL)
+		return va_list.crc;
+
+	return update_crc32c(va_list.crc, bm_data->data, bm_data->size);
+}
+
+uint32_t (crc32c_bm_bag)(struct bm_bag *bm_bag, struct crc32c_bm_bag va_list) {
+	if (bm_bag == NULL)
+		return va_list.crc;
+
+	uint32_t crc = va_list.crc;
+
+	for (struct bm_pocket *bm_pocket = bm_bag->start; bm_pocket != NULL; bm_pocket = bm_pocket->next)
+		crc = update_crc32c(crc, bm_pocket->data, bm_pocket->size);
+
+	return crc;
+}
+
+/* 64-bit hash: two lanes of 128-bit multiply folding over 32 byte stripes */
+
+#define BM_HASH_K0 0xA0761D6478BD642FULL
+#define BM_HASH_K1 0xE7037ED1A0B428DBULL
+#define BM_HASH_K2 0x8EBC6AF09C88C6E3ULL
+#define BM_HASH_K3 0x589965CC75374CC3ULL
+
+static inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+	__uint128_t product = (__uint128_t) a * b;
+
+	return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+static inline uint64_t hash_fold(uint64_t lane, uint64_t w0, uint64_t w1, uint64_t key) {
+	/* Accumulate, a zero product (w0 == key) still leaves the lane and w1 in */
+
+	return lane + w1 + hash_mix(w0 ^ key, w1 ^ lane);
+}
+
+static inline void hash_stripe(struct bm_hash *bm_hash, const uint8_t *bytes) {
+	bm_hash->lane[0] = hash_fold(bm_hash->lane[0], load_le64(bytes), load_le64(bytes + 8), bm_hash->key[0]);
+	bm_hash->lane[1] = hash_fold(bm_hash->lane[1], load_le64(bytes + 16), load_le64(bytes + 24), bm_hash->key[1]);
+}
+
+int (init_bm_hash)(struct bm_hash *bm_hash, struct init_bm_hash va_list) {
+	if (bm_hash == NULL)
+		return BM_ERROR_INVAL;
+
+	/* The seed goes into the stripe keys too, not only the starting lanes */
+
+	bm_hash->key[0] = BM_HASH_K0 + va_list.seed;
+	bm_hash->key[1] = BM_HASH_K1 - va_list.seed;
+	bm_hash->lane[0] = va_list.seed ^ BM_HASH_K2;
+	bm_hash->lane[1] = hash_mix(va_list.seed ^ BM_HASH_K3, BM_HASH_K0);
+	bm_hash->size = 0;
+	bm_hash->n_buf = 0;
+
+	return BM_ERROR_NONE;
+}
+
+int update_bm_hash(struct bm_hash *bm_hash, void *data, long size) {
+	if (bm_hash == NULL || size < 0 || (data == NULL && size > 0))
+		return BM_ERROR_INVAL;
+
+	const uint8_t *bytes = data;
+
+	bm_hash->size = bm_hash->size + size;
+
+	/* Top up a partial stripe left by the previous call */
+
+	if (bm_hash->n_buf > 0) {
+		int n_copy = size < BM_HASH_STRIPE - bm_hash->n_buf ? size : BM_HASH_STRIPE - bm_hash->n_buf;
+
+		memcpy(bm_hash->buf + bm_hash->n_buf, bytes, n_copy);
+		bm_hash->n_buf = bm_hash->n_buf + n_copy;
+		bytes = bytes + n_copy;
+		size = size - n_copy;
+
+		if (bm_hash->n_buf < BM_HASH_STRIPE)
+			return BM_ERROR_NONE;
+
+		hash_stripe(bm_hash, bm_hash->buf);
+		bm_hash->n_buf = 0;
+	}
+
+	for ( ; size >= BM_HASH_STRIPE; size = size - BM_HASH_STRIPE, bytes = bytes + BM_HASH_STRIPE)
+		hash_stripe(bm_hash, bytes);
+
+	if (size > 0)
+		memcpy(bm_hash->buf, bytes, size);
+
+	bm_hash->n_buf = size;
+
+	return BM_ERROR_NONE;
+}
+
+uint64_t digest_bm_hash(struct bm_hash *bm_hash) {
+	if (bm_hash == NULL)
+		return 0;
+
+	/* Tail in up to two word pairs, zero padded, then fold the lanes with the length */
+
+	uint8_t tail[BM_HASH_STRIPE] = {0};
+	uint64_t lane0 = bm_hash->lane[0], lane1 = bm_hash->lane[1];
+
+	memcpy(tail, bm_hash->buf, bm_hash->n_buf);
+
+	if (bm_hash->n_buf > 0)
+		lane0 = hash_fold(lane0, load_le64(tail), load_le64(tail + 8), bm_hash->key[0] ^ BM_HASH_K2);
+
+	if (bm_hash->n_buf > 16)
+		lane1 = hash_fold(lane1, load_le64(tail + 16), load_le64(tail + 24), bm_hash->key[1] ^ BM_HASH_K3);
+
+	uint64_t h = hash_mix(lane0 ^ BM_HASH_K1, lane1 ^ (uint64_t) bm_hash->size);
+
+	return hash_mix(h ^ BM_HASH_K0, (uint64_t) bm_hash->size ^ BM_HASH_K3);
+}
+
+uint64_t (hash_bm_data)(struct bm_data *bm_data, struct hash_bm_data va_list) {
+	struct bm_hash bm_hash;
+
+	init_bm_hash(&bm_hash, .seed = va_list.seed);
+
+	if (bm_data != NULL)
+		update_bm_hash(&bm_hash, bm_data->data, bm_data->size);
+
+	return digest_bm_hash(&bm_hash);
+}
+
+uint64_t (hash_bm_bag)(struct bm_bag *bm_bag, struct hash_bm_bag va_list) {
+	struct bm_hash bm_hash;
+
+	init_bm_hash(&bm_hash, .seed = va_list.seed);
+
+	for (struct bm_pocket *bm_pocket = bm_bag != NULL ? bm_bag->start : NULL; bm_pocket != NULL; \
+			bm_pocket = bm_pocket->next) {
+		if (bm_pocket->data != NULL && bm_pocket->size > 0)
+			update_bm_hash(&bm_hash, bm_pocket->data, bm_pocket->size);
+	}
+
+	return digest_bm_hash(&bm_hash);
+}
@@ -0,0 +1,784 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define BM_TEXT_X86
+#endif
+
+/* Alphabets and the lookup tables derived from them */
+
+struct base64_alphabet {
+	const char *chars;
+	uint8_t special;	// The one character whose offset from its value differs from the rest of its row
+	int8_t decode[256];	// -1 if not in the alphabet
+	int8_t shift[16];	// Encode: index class to ASCII offset
+	uint8_t lut_lo[16];	// Decode: row bits of the invalid bytes per low nibble
+	uint8_t lut_hi[16];	// Decode: row bit per high nibble
+	int8_t roll[16];	// Decode: ASCII to value offset per high nibble, the special character from 8 up
+};
+
+static struct base64_alphabet base64_alphabets[2] = {
+	{.chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", .special = '/'},
+	{.chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_", .special = '_'}
+};
+
+static const char hex_chars[16] = "0123456789abcdef";
+static int8_t hex_decode[256];
+static pthread_once_t text_once = PTHREAD_ONCE_INIT;
+
+static void init_base64_alphabet(struct base64_alphabet *alphabet) {
+	memset(alphabet->decode, -1, sizeof(alphabet->decode));
+
+	for (int n = 0; n < 64; n++)
+		alphabet->decode[(uint8_t) alphabet->chars[n]] = n;
+
+	/* Index classes: 0 for 26..51, 1..12 for 52..63, 13 for 0..25 */
+
+	alphabet->shift[0] = 'a' - 26;
+
+	for (int n = 1; n <= 10; n++)
+		alphabet->shift[n] = '0' - 52;
+
+	alphabet->shift[11] = alphabet->chars[62] - 62;
+	alphabet->shift[12] = alphabet->chars[63] - 63;
+	alphabet->shift[13] = 'A';
+
+	/* Rows 0x20..0x7F get a bit each, the rest share one and are invalid throughout */
+
+	for (int h = 0; h < 16; h++)
+		alphabet->lut_hi[h] = h >= 2 && h <= 7 ? 1 << (h - 2) : 0x40;
+
+	for (int l = 0; l < 16; l++) {
+		alphabet->lut_lo[l] = 0x40;
+
+		for (int h = 2; h <= 7; h++) {
+			if (alphabet->decode[h << 4 | l] < 0)
+				alphabet->lut_lo[l] = alphabet->lut_lo[l] | alphabet->lut_hi[h];
+		}
+	}
+
+	for (int n = 0; n < 64; n++) {
+		uint8_t c = alphabet->chars[n];
+
+		if (c == alphabet->special) {
+			for (int h = 8; h < 16; h++)
+				alphabet->roll[h] = n - c;
+		}
+		else
+			alphabet->roll[c >> 4] = n - c;
+	}
+}
+
+static void init_text() {
+	init_base64_alphabet(base64_alphabets);
+	init_base64_alphabet(base64_alphabets + 1);
+
+	memset(hex_decode, -1, sizeof(hex_decode));
+
+	for (int n = 0; n < 16; n++) {
+		hex_decode[(uint8_t) hex_chars[n]] = n;
+		hex_decode[(uint8_t) "0123456789ABCDEF"[n]] = n;
+	}
+}
+
+static inline int bm_text_ssse3() {
+#ifdef BM_TEXT_X86
+	return __builtin_cpu_supports("ssse3");
+#else
+	return 0;
+#endif
+}
+
+static inline int bm_text_avx2() {
+#ifdef BM_TEXT_X86
+	return __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+static inline int group_size(int codec) {	// Characters per decoded group
+	return codec == BM_HEX ? 2 : 4;
+}
+
+long encoded_size(long size, int codec, int pad) {
+	if (size < 0 || codec < BM_BASE64 || codec > BM_HEX)
+		return -1;
+
+	if (codec == BM_HEX)
+		return 2 * size;
+
+	return pad ? (size + 2) / 3 * 4 : size / 3 * 4 + (size % 3 != 0 ? size % 3 + 1 : 0);
+}
+
+long decoded_size(long size, int codec) {	// Upper bound, exact without padding
+	if (size < 0 || codec < BM_BASE64 || codec > BM_HEX)
+		return -1;
+
+	if (codec == BM_HEX)
+		return size / 2;
+
+	return size / 4 * 3 + (size % 4 > 1 ? size % 4 - 1 : 0);
+}
+
+/* Kernels over whole groups, each returning the input it covered */
+
+#ifdef BM_TEXT_X86
+__attribute__((target("ssse3")))
+static long encode_base64_ssse3(const uint8_t *in, long n_in, uint8_t *out, const struct base64_alphabet *alphabet) {
+	/* Twelve bytes spread over four 32-bit lanes, the 6-bit fields moved into place by multiplies */
+
+	const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m128i shift = _mm_loadu_si128((const __m128i*) alphabet->shift);
+	long at = 0;
+
+	for ( ; n_in - at >= 16; at = at + 12, out = out + 16) {
+		__m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (in + at)), spread);
+		__m128i index = _mm_or_si128( \
+				_mm_mulhi_epu16(_mm_and_si128(x, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040)), \
+				_mm_mullo_epi16(_mm_and_si128(x, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010)));
+		__m128i class = _mm_or_si128(_mm_subs_epu8(index, _mm_set1_epi8(51)), \
+				_mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), index), _mm_set1_epi8(13)));
+
+		_mm_storeu_si128((__m128i*) out, _mm_add_epi8(_mm_shuffle_epi8(shift, class), index));
+	}
+
+	return at;
+}
+
+__attribute__((target("avx2")))
+static long encode_base64_avx2(const uint8_t *in, long n_in, uint8_t *out, const struct base64_alphabet *alphabet) {
+	const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, \
+			1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i shift = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) alphabet->shift));
+	long at = 0;
+
+	for ( ; n_in - at >= 28; at = at + 24, out = out + 32) {
+		__m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (in + at))), \
+				_mm_loadu_si128((const __m128i*) (in + at + 12)), 1);
+
+		x = _mm256_shuffle_epi8(x, spread);
+
+		__m256i index = _mm256_or_si256( \
+				_mm256_mulhi_epu16(_mm256_and_si256(x, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040)), \
+				_mm256_mullo_epi16(_mm256_and_si256(x, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010)));
+		__m256i class = _mm256_or_si256(_mm256_subs_epu8(index, _mm256_set1_epi8(51)), \
+				_mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), index), _mm256_set1_epi8(13)));
+
+		_mm256_storeu_si256((__m256i*) out, _mm256_add_epi8(_mm256_shuffle_epi8(shift, class), index));
+	}
+
+	return at;
+}
+
+__attribute__((target("ssse3")))
+static long decode_base64_ssse3(const uint8_t *in, long n_in, uint8_t *out, long n_out, \
+		const struct base64_alphabet *alphabet) {	// Stops ahead of a block with a byte outside the alphabet
+	/* Validity from two nibble lookups, values from a per-row offset, then four 6-bit fields to three bytes */
+
+	const __m128i lut_lo = _mm_loadu_si128((const __m128i*) alphabet->lut_lo);
+	const __m128i lut_hi = _mm_loadu_si128((const __m128i*) alphabet->lut_hi);
+	const __m128i roll = _mm_loadu_si128((const __m128i*) alphabet->roll);
+	const __m128i special = _mm_set1_epi8(alphabet->special), nibble = _mm_set1_epi8(0x0F);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	long at = 0;
+
+	for ( ; n_in - at >= 16 && n_out >= 16; at = at + 16, out = out + 12, n_out = n_out - 12) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (in + at));
+		__m128i hi = _mm_and_si128(_mm_srli_epi32(x, 4), nibble);
+		__m128i bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, _mm_and_si128(x, nibble)), _mm_shuffle_epi8(lut_hi, hi));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF)
+			break;
+
+		hi = _mm_or_si128(hi, _mm_and_si128(_mm_cmpeq_epi8(x, special), _mm_set1_epi8(8)));
+		x = _mm_add_epi8(x, _mm_shuffle_epi8(roll, hi));
+		x = _mm_madd_epi16(_mm_maddubs_epi16(x, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+
+		_mm_storeu_si128((__m128i*) out, _mm_shuffle_epi8(x, pack));
+	}
+
+	return at;
+}
+
+__attribute__((target("avx2")))
+static long decode_base64_avx2(const uint8_t *in, long n_in, uint8_t *out, long n_out, \
+		const struct base64_alphabet *alphabet) {
+	const __m256i lut_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) alphabet->lut_lo));
+	const __m256i lut_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) alphabet->lut_hi));
+	const __m256i roll = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) alphabet->roll));
+	const __m256i special = _mm256_set1_epi8(alphabet->special), nibble = _mm256_set1_epi8(0x0F);
+	const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, \
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+	long at = 0;
+
+	for ( ; n_in - at >= 32 && n_out >= 32; at = at + 32, out = out + 24, n_out = n_out - 24) {
+		__m256i x = _mm256_loadu_si256((const __m256i*) (in + at));
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi32(x, 4), nibble);
+		__m256i bad = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, _mm256_and_si256(x, nibble)), \
+				_mm256_shuffle_epi8(lut_hi, hi));
+
+		if (!_mm256_testz_si256(bad, bad))
+			break;
+
+		hi = _mm256_or_si256(hi, _mm256_and_si256(_mm256_cmpeq_epi8(x, special), _mm256_set1_epi8(8)));
+		x = _mm256_add_epi8(x, _mm256_shuffle_epi8(roll, hi));
+		x = _mm256_madd_epi16(_mm256_maddubs_epi16(x, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+
+		_mm256_storeu_si256((__m256i*) out, _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, pack), lanes));
+	}
+
+	return at;
+}
+
+__attribute__((target("ssse3")))
+static long encode_hex_ssse3(const uint8_t *in, long n_in, uint8_t *out) {
+	const __m128i digits = _mm_loadu_si128((const __m128i*) hex_chars), nibble = _mm_set1_epi8(0x0F);
+	long at = 0;
+
+	for ( ; n_in - at >= 16; at = at + 16, out = out + 32) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (in + at));
+		__m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+		__m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(x, nibble));
+
+		_mm_storeu_si128((__m128i*) out, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*) (out + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+
+	return at;
+}
+
+__attribute__((target("avx2")))
+static long encode_hex_avx2(const uint8_t *in, long n_in, uint8_t *out) {
+	const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) hex_chars));
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	long at = 0;
+
+	for ( ; n_in - at >= 32; at = at + 32, out = out + 64) {
+		/* Quadwords reordered so the in-lane unpacks come out in byte order */
+
+		__m256i x = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*) (in + at)), 0xD8);
+		__m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+		__m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(x, nibble));
+
+		_mm256_storeu_si256((__m256i*) out, _mm256_unpacklo_epi8(hi, lo));
+		_mm256_storeu_si256((__m256i*) (out + 32), _mm256_unpackhi_epi8(hi, lo));
+	}
+
+	return at;
+}
+
+static inline __m128i hex_values(__m128i x, __m128i *valid) {
+	__m128i digit = _mm_sub_epi8(x, _mm_set1_epi8('0'));
+	__m128i letter = _mm_sub_epi8(_mm_or_si128(x, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+	__m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+
+	*valid = _mm_and_si128(*valid, _mm_or_si128(is_digit, is_letter));
+
+	return _mm_or_si128(_mm_and_si128(is_digit, digit), \
+			_mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3")))
+static long decode_hex_ssse3(const uint8_t *in, long n_in, uint8_t *out) {
+	const __m128i weights = _mm_set1_epi16(0x0110);	// High nibble first
+	long at = 0;
+
+	for ( ; n_in - at >= 32; at = at + 32, out = out + 16) {
+		__m128i valid = _mm_set1_epi8(-1);
+		__m128i a = hex_values(_mm_loadu_si128((const __m128i*) (in + at)), &valid);
+		__m128i b = hex_values(_mm_loadu_si128((const __m128i*) (in + at + 16)), &valid);
+
+		if (_mm_movemask_epi8(valid) != 0xFFFF)
+			break;
+
+		_mm_storeu_si128((__m128i*) out, _mm_packus_epi16(_mm_maddubs_epi16(a, weights), \
+				_mm_maddubs_epi16(b, weights)));
+	}
+
+	return at;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hex_values_avx2(__m256i x, __m256i *valid) {
+	__m256i digit = _mm256_sub_epi8(x, _mm256_set1_epi8('0'));
+	__m256i letter = _mm256_sub_epi8(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	__m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+	__m256i is_letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+
+	*valid = _mm256_and_si256(*valid, _mm256_or_si256(is_digit, is_letter));
+
+	return _mm256_or_si256(_mm256_and_si256(is_digit, digit), \
+			_mm256_and_si256(is_letter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2")))
+static long decode_hex_avx2(const uint8_t *in, long n_in, uint8_t *out) {
+	const __m256i weights = _mm256_set1_epi16(0x0110);
+	long at = 0;
+
+	for ( ; n_in - at >= 64; at = at + 64, out = out + 32) {
+		__m256i valid = _mm256_set1_epi8(-1);
+		__m256i a = hex_values_avx2(_mm256_loadu_si256((const __m256i*) (in + at)), &valid);
+		__m256i b = hex_values_avx2(_mm256_loadu_si256((const __m256i*) (in + at + 32)), &valid);
+
+		if (_mm256_movemask_epi8(valid) != -1)
+			break;
+
+		__m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights), _mm256_maddubs_epi16(b, weights));
+
+		_mm256_storeu_si256((__m256i*) out, _mm256_permute4x64_epi64(bytes, 0xD8));
+	}
+
+	return at;
+}
+#endif
+
+/* Whole groups: 3 bytes to 4 characters, or 1 byte to 2 */
+
+static void encode_groups(int codec, const uint8_t *in, long n_in, uint8_t *out) {
+	long at = 0;
+
+	if (codec == BM_HEX) {
+#ifdef BM_TEXT_X86
+		if (n_in >= 32 && bm_text_avx2())
+			at = encode_hex_avx2(in, n_in, out);
+
+		if (n_in - at >= 16 && bm_text_ssse3())
+			at = at + encode_hex_ssse3(in + at, n_in - at, out + 2 * at);
+#endif
+
+		for ( ; at < n_in; at++) {
+			out[2 * at] = hex_chars[in[at] >> 4];
+			out[2 * at + 1] = hex_chars[in[at] & 0x0F];
+		}
+
+		return;
+	}
+
+	const struct base64_alphabet *alphabet = base64_alphabets + codec;
+
+#ifdef BM_TEXT_X86
+	if (n_in >= 28 && bm_text_avx2())
+		at = encode_base64_avx2(in, n_in, out, alphabet);
+
+	if (n_in - at >= 16 && bm_text_ssse3())
+		at = at + encode_base64_ssse3(in + at, n_in - at, out + at / 3 * 4, alphabet);
+#endif
+
+	for (out = out + at / 3 * 4; at < n_in; at = at + 3, out = out + 4) {
+		uint32_t word = in[at] << 16 | in[at + 1] << 8 | in[at + 2];
+
+		out[0] = alphabet->chars[word >> 18];
+		out[1] = alphabet->chars[(word >> 12) & 0x3F];
+		out[2] = alphabet->chars[(word >> 6) & 0x3F];
+		out[3] = alphabet->chars[word & 0x3F];
+	}
+}
+
+static int decode_groups(int codec, const uint8_t *in, long n_in, uint8_t *out) {	// No padding
+	long at = 0;
+
+	if (codec == BM_HEX) {
+#ifdef BM_TEXT_X86
+		if (n_in >= 64 && bm_text_avx2())
+			at = decode_hex_avx2(in, n_in, out);
+
+		if (n_in - at >= 32 && bm_text_ssse3())
+			at = at + decode_hex_ssse3(in + at, n_in - at, out + at / 2);
+#endif
+
+		for ( ; at < n_in; at = at + 2) {
+			int hi = hex_decode[in[at]], lo = hex_decode[in[at + 1]];
+
+			if ((hi | lo) < 0)
+				return BM_ERROR_INVAL;
+
+			out[at / 2] = hi << 4 | lo;
+		}
+
+		return BM_ERROR_NONE;
+	}
+
+	const struct base64_alphabet *alphabet = base64_alphabets + codec;
+
+#ifdef BM_TEXT_X86
+	if (n_in >= 32 && bm_text_avx2())
+		at = decode_base64_avx2(in, n_in, out, n_in / 4 * 3, alphabet);
+
+	if (n_in - at >= 16 && bm_text_ssse3())
+		at = at + decode_base64_ssse3(in + at, n_in - at, out + at / 4 * 3, (n_in - at) / 4 * 3, alphabet);
+#endif
+
+	for (out = out + at / 4 * 3; at < n_in; at = at + 4, out = out + 3) {
+		int32_t a = alphabet->decode[in[at]], b = alphabet->decode[in[at + 1]];
+		int32_t c = alphabet->decode[in[at + 2]], d = alphabet->decode[in[at + 3]];
+
+		if ((a | b | c | d) < 0)
+			return BM_ERROR_INVAL;
+
+		uint32_t word = a << 18 | b << 12 | c << 6 | d;
+
+		out[0] = word >> 16;
+		out[1] = word >> 8;
+		out[2] = word;
+	}
+
+	return BM_ERROR_NONE;
+}
+
+/* Last base64 group: 1 or 2 bytes left over, or 2 to 4 characters with optional padding */
+
+static long encode_final(int codec, int pad, const uint8_t *in, long n_in, uint8_t *out) {	// Characters written
+	const char *chars = base64_alphabets[codec].chars;
+	uint32_t word = in[0] << 16 | (n_in > 1 ? in[1] << 8 : 0);
+
+	out[0] = chars[word >> 18];
+	out[1] = chars[(word >> 12) & 0x3F];
+
+	if (n_in > 1)
+		out[2] = chars[(word >> 6) & 0x3F];
+
+	if (!pad)
+		return n_in + 1;
+
+	if (n_in == 1)
+		out[2] = '=';
+
+	out[3] = '=';
+
+	return 4;
+}
+
+static long final_padding(const uint8_t *group, long n_char) {
+	long n_pad = 0;
+
+	for ( ; n_pad < n_char && group[n_char - n_pad - 1] == '='; n_pad++)
+		;
+
+	return n_pad;
+}
+
+static long decode_final(int codec, const uint8_t *group, long n_char, uint8_t *out) {	// Bytes written, -1 if malformed
+	long n_pad = final_padding(group, n_char);
+
+	if (n_pad > 0 && n_char != 4)	// Padding only fills a whole group
+		return -1;
+
+	n_char = n_char - n_pad;
+
+	if (n_char < 2 || n_char > 3)
+		return -1;
+
+	const int8_t *decode = base64_alphabets[codec].decode;
+	int32_t a = decode[group[0]], b = decode[group[1]], c = n_char > 2 ? decode[group[2]] : 0;
+
+	if ((a | b | c) < 0)
+		return -1;
+
+	uint32_t word = a << 18 | b << 12 | c << 6;
+
+	if ((word & (n_char == 2 ? 0xFFFF : 0xFF)) != 0)	// Bits past the last byte must be zero
+		return -1;
+
+	out[0] = word >> 16;
+
+	if (n_char > 2)
+		out[1] = word >> 8;
+
+	return n_char - 1;
+}
+
+int (encode_bm_data)(struct bm_data *src, struct bm_data *dst, struct encode_bm_data va_list) {
+	if (src == NULL || dst == NULL || src->size < 0 || (src->data == NULL && src->size > 0) || \
+			va_list.codec < BM_BASE64 || va_list.codec > BM_HEX || va_list.offset < 0 || \
+			va_list.offset > dst->size || (dst->data == NULL && dst->size > 0)) {
+		va_list.written != NULL ? *(va_list.written) = 0 : 0;
+		return BM_ERROR_INVAL;
+	}
+
+	long n_out = encoded_size(src->size, va_list.codec, va_list.pad);
+
+	if (n_out > dst->size - va_list.offset) {
+		va_list.written != NULL ? *(va_list.written) = 0 : 0;
+		return BM_ERROR_BUFFER_FULL;
+	}
+
+	pthread_once(&text_once, init_text);
+
+	uint8_t *in = src->data, *out = dst->data + va_list.offset;
+	long n_group = va_list.codec == BM_HEX ? src->size : src->size / 3 * 3;
+
+	encode_groups(va_list.codec, in, n_group, out);
+
+	if (n_group < src->size)
+		encode_final(va_list.codec, va_list.pad, in + n_group, src->size - n_group, out + n_group / 3 * 4);
+
+	va_list.written != NULL ? *(va_list.written) = n_out : 0;
+
+	return BM_ERROR_NONE;
+}
+
+int (decode_bm_data)(struct bm_data *src, struct bm_data *dst, struct decode_bm_data va_list) {
+	if (src == NULL || dst == NULL || src->size < 0 || (src->data == NULL && src->size > 0) || \
+			va_list.codec < BM_BASE64 || va_list.codec > BM_HEX || va_list.offset < 0 || \
+			va_list.offset > dst->size || (dst->data == NULL && dst->size > 0)) {
+		va_list.written != NULL ? *(va_list.written) = 0 : 0;
+		return BM_ERROR_INVAL;
+	}
+
+	va_list.written != NULL ? *(va_list.written) = 0 : 0;
+
+	/* Exact size up front: whole groups, then a short or padded base64 group */
+
+	uint8_t *in = src->data, *out = dst->data + va_list.offset;
+	long g = group_size(va_list.codec), n_final = src->size % g;
+
+	if (va_list.codec != BM_HEX && n_final == 0 && src->size > 0 && final_padding(in + src->size - 4, 4) > 0)
+		n_final = 4;
+
+	if ((va_list.codec == BM_HEX && n_final != 0) || n_final == 1)
+		return BM_ERROR_INVAL;
+
+	long n_group = src->size - n_final;
+	long n_out = n_group / g * (g - 1) + (n_final > 0 ? n_final - 1 - final_padding(in + n_group, n_final) : 0);
+
+	if (n_out > dst->size - va_list.offset)
+		return BM_ERROR_BUFFER_FULL;
+
+	pthread_once(&text_once, init_text);
+
+	if (decode_groups(va_list.codec, in, n_group, out) != BM_ERROR_NONE || \
+			(n_final > 0 && decode_final(va_list.codec, in + n_group, n_final, out + n_group / 4 * 3) < 0))
+		return BM_ERROR_INVAL;
+
+	va_list.written != NULL ? *(va_list.written) = n_out : 0;
+
+	return BM_ERROR_NONE;
+}
+
+int (init_bm_text)(struct bm_text *bm_text, struct init_bm_text va_list) {
+	if (bm_text == NULL || va_list.codec < BM_BASE64 || va_list.codec > BM_HEX)
+		return BM_ERROR_INVAL;
+
+	memset(bm_text, 0, sizeof(struct bm_text));
+
+	bm_text->codec = va_list.codec;
+	bm_text->decode = va_list.decode;
+	bm_text->pad = va_list.pad;
+
+	return BM_ERROR_NONE;
+}
+
+/* Streaming: a group straddling calls is completed from bm_text{}->carry, the rest coded in place */
+
+static inline uint8_t stream_byte(const uint8_t *carry, long n_carry, const uint8_t *in, long at) {
+	return at < n_carry ? carry[at] : in[at - n_carry];
+}
+
+int (encode_bm_text)(struct bm_text *bm_text, struct bm_data *bm_data, struct bm_bag *dst, struct encode_bm_text va_list) {
+	if (bm_text == NULL || bm_text->decode || dst == NULL || bm_data == NULL || bm_data->size < 0 || \
+			(bm_data->data == NULL && bm_data->size > 0))
+		return BM_ERROR_INVAL;
+
+	const uint8_t *in = bm_data->data;
+	long g = bm_text->codec == BM_HEX ? 1 : 3, n_carry = bm_text->n_carry, total = n_carry + bm_data->size;
+	long n_group = total / g, n_rest = total % g;
+	long n_out = n_group * (g + 1) + (va_list.flush ? encoded_size(n_rest, bm_text->codec, bm_text->pad) : 0);
+	uint8_t group[3];
+
+	if (n_out == 0) {
+		if (bm_data->size > 0)
+			memcpy(bm_text->carry + n_carry, in, bm_data->size);
+
+		bm_text->n_carry = va_list.flush ? 0 : total;
+		return BM_ERROR_NONE;
+	}
+
+	int ap_status = append_bm_pocket(dst, n_out);
+
+	if (ap_status != BM_ERROR_NONE)
+		return ap_status;
+
+	pthread_once(&text_once, init_text);
+
+	uint8_t *out = dst->end->data;
+	long at = 0, n_whole = n_group;
+
+	if (n_carry > 0 && n_whole > 0) {
+		for (int k = 0; k < g; k++)
+			group[k] = stream_byte(bm_text->carry, n_carry, in, k);
+
+		encode_groups(bm_text->codec, group, g, out);
+
+		at = g - n_carry;
+		out = out + g + 1;
+		n_whole--;
+	}
+
+	encode_groups(bm_text->codec, in + at, n_whole * g, out);
+
+	/* Leftover bytes wait for the next call, or close the stream */
+
+	for (long k = 0; k < n_rest; k++)
+		group[k] = stream_byte(bm_text->carry, n_carry, in, total - n_rest + k);
+
+	if (va_list.flush && n_rest > 0)
+		encode_final(bm_text->codec, bm_text->pad, group, n_rest, out + n_whole * (g + 1));
+
+	bm_text->n_carry = va_list.flush ? 0 : n_rest;
+	memcpy(bm_text->carry, group, bm_text->n_carry);
+
+	return BM_ERROR_NONE;
+}
+
+int (encode_bm_text_bag)(struct bm_text *bm_text, struct bm_bag *src, struct bm_bag *dst, struct encode_bm_text va_list) {
+	if (bm_text == NULL || src == NULL || dst == NULL || src == dst)
+		return BM_ERROR_INVAL;
+
+	for (struct bm_pocket *bm_pocket = src->start; bm_pocket != NULL; bm_pocket = bm_pocket->next) {
+		struct bm_data bm_data = {.data = bm_pocket->data, .size = bm_pocket->data != NULL ? bm_pocket->size : 0};
+		int en_status = encode_bm_text(bm_text, &bm_data, dst, .flush = va_list.flush && bm_pocket->next == NULL);
+
+		if (en_status != BM_ERROR_NONE)
+			return en_status;
+	}
+
+	if (src->start == NULL && va_list.flush) {
+		struct bm_data empty = {.data = NULL, .size = 0};
+		return encode_bm_text(bm_text, &empty, dst, .flush = 1);
+	}
+
+	return BM_ERROR_NONE;
+}
+
+int (decode_bm_text)(struct bm_text *bm_text, struct bm_data *bm_data, struct bm_bag *dst, struct decode_bm_text va_list) {
+	if (bm_text == NULL || !bm_text->decode || dst == NULL || bm_data == NULL || bm_data->size < 0 || \
+			(bm_data->data == NULL && bm_data->size > 0))
+		return BM_ERROR_INVAL;
+
+	const uint8_t *in = bm_data->data;
+	long g = group_size(bm_text->codec), n_carry = bm_text->n_carry, total = n_carry + bm_data->size;
+	long n_group = total / g, n_rest = total % g, n_pad = 0;
+	uint8_t group[4];
+
+	if (bm_text->ended && bm_data->size > 0)	// Past the padding
+		goto decode_error;
+
+	/* Sized up front: padding may only close the last whole group, a short group only the stream */
+
+	if (bm_text->codec != BM_HEX && n_group > 0) {
+		for (long k = 0; k < 4; k++)
+			group[k] = stream_byte(bm_text->carry, n_carry, in, (n_group - 1) * 4 + k);
+
+		n_pad = final_padding(group, 4);
+	}
+
+	if ((n_pad > 0 && n_rest > 0) || n_pad > 2 || \
+			(va_list.flush && (n_rest == 1 || (bm_text->codec == BM_HEX && n_rest > 0))))
+		goto decode_error;
+
+	long n_out = n_group * (g - 1) - n_pad + (va_list.flush && n_rest > 0 ? n_rest - 1 : 0);
+
+	if (n_out == 0) {
+		if (bm_data->size > 0)
+			memcpy(bm_text->carry + n_carry, in, bm_data->size);
+
+		bm_text->n_carry = va_list.flush ? 0 : total;
+		bm_text->ended = bm_text->ended && !va_list.flush;
+		return BM_ERROR_NONE;
+	}
+
+	int ap_status = append_bm_pocket(dst, n_out);
+
+	if (ap_status != BM_ERROR_NONE)
+		return ap_status;
+
+	pthread_once(&text_once, init_text);
+
+	uint8_t *out = dst->end->data;
+	long at = 0, n_whole = n_group - (n_pad > 0);
+
+	if (n_carry > 0 && n_whole > 0) {
+		for (int k = 0; k < g; k++)
+			group[k] = stream_byte(bm_text->carry, n_carry, in, k);
+
+		if (decode_groups(bm_text->codec, group, g, out) != BM_ERROR_NONE)
+			goto drop_pocket;
+
+		at = g - n_carry;
+		out = out + g - 1;
+		n_whole--;
+	}
+
+	if (decode_groups(bm_text->codec, in + at, n_whole * g, out) != BM_ERROR_NONE)
+		goto drop_pocket;
+
+	/* The padded group or the short one closing the stream, else the leftover is carried */
+
+	long n_final = n_pad > 0 ? 4 : (va_list.flush ? n_rest : 0), n_left = n_pad > 0 ? 4 : n_rest;
+
+	for (long k = 0; k < n_left; k++)
+		group[k] = stream_byte(bm_text->carry, n_carry, in, total - n_rest - (n_pad > 0 ? 4 : 0) + k);
+
+	if (n_final > 0 && decode_final(bm_text->codec, group, n_final, out + n_whole * (g - 1)) < 0)
+		goto drop_pocket;
+
+	bm_text->ended = n_pad > 0 && !va_list.flush;
+	bm_text->n_carry = n_final > 0 ? 0 : n_rest;
+	memcpy(bm_text->carry, group, bm_text->n_carry);
+
+	return BM_ERROR_NONE;
+
+drop_pocket: ;
+	struct bm_pocket *bm_pocket = dst->end;
+
+	delete_bm_pocket(dst, &bm_pocket);
+
+decode_error:
+	bm_text->n_carry = 0;
+	bm_text->ended = 0;
+
+	return BM_ERROR_INVAL;
+}
+
+int (decode_bm_text_bag)(struct bm_text *bm_text, struct bm_bag *src, struct bm_bag *dst, struct decode_bm_text va_list) {
+	if (bm_text == NULL || src == NULL || dst == NULL || src == dst)
+		return BM_ERROR_INVAL;
+
+	for (struct bm_pocket *bm_pocket = src->start; bm_pocket != NULL; bm_pocket = bm_pocket->next) {
+		struct bm_data bm_data = {.data = bm_pocket->data, .size = bm_pocket->data != NULL ? bm_pocket->size : 0};
+		int dc_status = decode_bm_text(bm_text, &bm_data, dst, .flush = va_list.flush && bm_pocket->next == NULL);
+
+		if (dc_status != BM_ERROR_NONE)
+			return dc_status;
+	}
+
+	if (src->start == NULL && va_list.flush) {
+		struct bm_data empty = {.data = NULL, .size = 0};
+		return decode_bm_text(bm_text, &empty, dst, .flush = 1);
+	}
+
+	return BM_ERROR_NONE;
+}
@@ -20,6 +20,26 @@
 #include <stdarg.h>
 #include <string.h>
 
+/* Pin the mask layout, each flag owns bit flag % 64 of word flag / 64 */
+
+_Static_assert(sizeof(struct bm_flags) * 8 >= 128, "bm_flags{} holds at least 128 flags");
+_Static_assert(BM_FLAGS_WORD(0) == 0 && BM_FLAGS_WORD(1) == 0, "set_flags() sets nothing");
+_Static_assert(BM_FLAGS_WORD(0, BM_FREE_INPUT, BM_MODE_AUTO_RETRY) == 0x41, "flags map to their own bits");
+_Static_assert(BM_FLAGS_WORD(0, BM_SSEEK_PERMIT) == 1ULL << 4 && \
+		BM_FLAGS_WORD(0, BM_SSEEK_DELIMIT) == 1ULL << 5, "flags past a nibble stay in range");
+_Static_assert(BM_FLAGS_WORD(0, 67) == 0 && BM_FLAGS_WORD(1, 67) == 1ULL << 3, "flags past 63 use the next word");
+_Static_assert(BM_FLAGS_WORD(0, 2, 2) == 1ULL << 2, "repeated flags are idempotent");
+
+static inline void put_flag(struct bm_flags *flags, int flag, int on) {
+	if ((unsigned int) flag >= 64 * BM_FLAGS_WORDS)
+		return;
+
+	if (on)
+		flags->f[flag / 64] |= 1ULL << (flag % 64);
+	else
+		flags->f[flag / 64] &= ~(1ULL << (flag % 64));
+}
+
 struct bm_flags bm_set_flags(int first, ...) {
 	struct bm_flags flags;
 	memset(&flags, 0, sizeof(struct bm_flags));
@@ -27,6 +47,8 @@ struct bm_flags bm_set_flags(int first, ...) {
 	if (first == -1) // Return with no flag set
 		return flags;
 
+	put_flag(&flags, first, 1);
+
 	/* Iterate through variadac arguments and set flags */
 	va_list ap;
 
@@ -37,25 +59,39 @@ struct bm_flags bm_set_flags(int first, ...) {
 		if (flag == -1)
 			break;
 
-		set_bit((void*) flags.f, flag);
+		put_flag(&flags, flag, 1);
 	}
 	va_end(ap);
 
 	return flags;
 }
 
-int isflag_set(struct bm_flags flags, int flag) {
-	if (flag == -1)
-		return 0;
+int (isflag_set)(struct bm_flags flags, int flag) {
+	return bm_isflag_set(flags, flag);
+}
+
+int bm_clear_flags(struct bm_flags flags, ...) {
 
-	/* Compute flag location */
-	int q = flag / sizeof(uint32_t);
-	int r = flag % sizeof(uint32_t);
+	/* Iterate through variadic arguments and clear flags */
+	va_list ap;
 
-	return (int) get_bit((void*) &(flags.f[q]), r);
+	va_start(ap, flags);
+	int flag;
+	for ( ; ; ) {
+		flag = va_arg(ap, int);
+		if (flag == -1)
+			break;
+
+		put_flag(&flags, flag, 0);
+	}
+	va_end(ap);
+
+	return BM_ERROR_NONE;
 }
 
-int bm_clear_flags(struct bm_flags flags, ...) {
+int bm_unset_flags(struct bm_flags *flags, ...) {
+	if (flags == NULL)
+		return BM_ERROR_INVAL;
 
 	/* Iterate through variadic arguments and clear flags */
 	va_list ap;
@@ -67,7 +103,7 @@ int bm_clear_flags(struct bm_flags flags, ...) {
 		if (flag == -1)
 			break;
 
-		clear_bit((void*) flags.f, flag);
+		put_flag(flags, flag, 0);
 	}
 	va_end(ap);
 
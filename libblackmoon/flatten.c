@@ -0,0 +1,286 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define BM_FLATTEN_NT_SIZE (8L << 20)	// Bypass the cache above this size
+#define BM_FLATTEN_MT_SIZE (64L << 20)	// Split the copy across threads above this size
+#define BM_FLATTEN_THREADS 8
+
+struct bm_segment {
+	void *src;
+	long dst_off;
+	long size;
+};
+
+struct bm_flatten_job {
+	struct bm_segment *seg;
+	long n_seg;
+	void *dst;
+	long start;
+	long end;
+	int nt_copy;
+};
+
+static void flatten_copy(void *dst, void *src, long size, int nt_copy) {
+#ifdef __SSE2__
+	if (nt_copy && size >= 256) {
+		/* Align the destination, then stream 64 bytes at a time */
+
+		long head = (16 - ((uintptr_t) dst & 15)) & 15;
+
+		memcpy(dst, src, head);
+		dst = dst + head;
+		src = src + head;
+		size = size - head;
+
+		for ( ; size >= 64; size = size - 64, dst = dst + 64, src = src + 64) {
+			__m128i x0 = _mm_loadu_si128((__m128i*) src);
+			__m128i x1 = _mm_loadu_si128((__m128i*) src + 1);
+			__m128i x2 = _mm_loadu_si128((__m128i*) src + 2);
+			__m128i x3 = _mm_loadu_si128((__m128i*) src + 3);
+
+			_mm_stream_si128((__m128i*) dst, x0);
+			_mm_stream_si128((__m128i*) dst + 1, x1);
+			_mm_stream_si128((__m128i*) dst + 2, x2);
+			_mm_stream_si128((__m128i*) dst + 3, x3);
+		}
+
+		memcpy(dst, src, size);
+		_mm_sfence();
+
+		return;
+	}
+#endif
+	memcpy(dst, src, size);
+}
+
+static void* flatten_worker(void *arg) {
+	struct bm_flatten_job *job = arg;
+
+	/* Binary search the bm_segment{} holding job->start */
+
+	long lo = 0, hi = job->n_seg - 1;
+
+	while (lo < hi) {
+		long mid = (lo + hi + 1) / 2;
+
+		if (job->seg[mid].dst_off <= job->start)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	/* Copy the [start, end) share of the destination */
+
+	for (long at = lo; at < job->n_seg && job->seg[at].dst_off < job->end; at++) {
+		long c_start = job->seg[at].dst_off > job->start ? job->seg[at].dst_off : job->start;
+		long c_end = job->seg[at].dst_off + job->seg[at].size < job->end ? \
+				job->seg[at].dst_off + job->seg[at].size : job->end;
+
+		if (c_end > c_start)
+			flatten_copy(job->dst + c_start, job->seg[at].src + (c_start - job->seg[at].dst_off), \
+					c_end - c_start, job->nt_copy);
+	}
+
+	return NULL;
+}
+
+static int flatten_threaded(struct bm_bag *bm_bag, long offset, void *dst, long f_size, \
+		int n_thread, int nt_copy) {
+	/* Lay out the source bm_pocket{} against destination offsets */
+
+	struct bm_segment *seg = malloc(bm_bag->n_pkt * sizeof(struct bm_segment));
+
+	if (seg == NULL)
+		return BM_ERROR_FATAL;
+
+	long n_seg = 0, p_offset = 0, dst_off = 0;
+
+	for (struct bm_pocket *bm_pocket = locate_bm_bag(bm_bag, offset, &p_offset); \
+			bm_pocket != NULL && dst_off < f_size; bm_pocket = bm_pocket->next) {
+		if (bm_pocket->data == NULL || bm_pocket->size <= p_offset) {
+			p_offset = 0;
+			continue;
+		}
+
+		seg[n_seg].src = bm_pocket->data + p_offset;
+		seg[n_seg].dst_off = dst_off;
+		seg[n_seg].size = bm_pocket->size - p_offset < f_size - dst_off ? \
+				bm_pocket->size - p_offset : f_size - dst_off;
+
+		dst_off = dst_off + seg[n_seg].size;
+		n_seg = n_seg + 1;
+		p_offset = 0;
+	}
+
+	/* Hand out equal byte shares, the caller's thread takes the first */
+
+	struct bm_flatten_job job[BM_FLATTEN_THREADS];
+	pthread_t tid[BM_FLATTEN_THREADS];
+	int t_started[BM_FLATTEN_THREADS];
+
+	for (int t_count = 0; t_count < n_thread; t_count++) {
+		job[t_count] = (struct bm_flatten_job) {.seg = seg, .n_seg = n_seg, .dst = dst, \
+			.start = f_size / n_thread * t_count, .end = t_count == n_thread - 1 ? \
+				f_size : f_size / n_thread * (t_count + 1), .nt_copy = nt_copy};
+
+		t_started[t_count] = t_count > 0 && \
+				pthread_create(&tid[t_count], NULL, flatten_worker, &job[t_count]) == 0;
+	}
+
+	for (int t_count = 0; t_count < n_thread; t_count++) {
+		if (t_started[t_count])
+			continue;
+
+		flatten_worker(&job[t_count]);	// Our share, or a thread that failed to start
+	}
+
+	for (int t_count = 1; t_count < n_thread; t_count++) {
+		if (t_started[t_count])
+			pthread_join(tid[t_count], NULL);
+	}
+
+	free(seg);
+
+	return BM_ERROR_NONE;
+}
+
+struct bm_data* (flatten_bm_bag)(struct bm_bag *bm_bag, struct flatten_bm_bag va_list) {
+	if (bm_bag == NULL)
+		return va_list.into != NULL ? va_list.into : calloc(1, sizeof(struct bm_data));
+
+	if (va_list.offset < 0 || va_list.length < 0 || (va_list.into != NULL && \
+			(va_list.into->data == NULL && va_list.into->size > 0)))
+		return NULL;
+
+	/* Compute the memory requirements of the flattened range */
+
+	long t_size = size_bm_bag(bm_bag);
+	long f_size = va_list.offset >= t_size ? 0 : (va_list.length < t_size - va_list.offset ? \
+			va_list.length : t_size - va_list.offset);
+
+	/* Flatten into the caller's buffer or a new bm_data{} */
+
+	struct bm_data *bm_data = va_list.into;
+
+	if (bm_data != NULL) {
+		f_size = f_size < bm_data->size ? f_size : bm_data->size;
+	}
+	else {
+		bm_data = calloc(1, sizeof(struct bm_data));
+
+		if (bm_data == NULL)
+			return NULL;
+
+		if (f_size > 0) {
+			bm_data->data = malloc(f_size);
+
+			if (bm_data->data == NULL) {
+				free(bm_data);
+				return NULL;
+			}
+		}
+	}
+
+	bm_data->size = f_size;
+
+	int nt_copy = f_size >= BM_FLATTEN_NT_SIZE;
+
+	if (isflag_set(va_list.flags, BM_FREE_INPUT)) {
+		/* Consume bm_pocket{} as they are copied to bound the peak memory */
+
+		long pos = 0, f_end = va_list.offset + f_size;
+
+		for (struct bm_pocket *bm_pocket = bm_bag->start, *next = NULL; \
+				bm_pocket != NULL; bm_pocket = next) {
+			next = bm_pocket->next;
+
+			long c_start = pos > va_list.offset ? pos : va_list.offset;
+			long c_end = pos + bm_pocket->size < f_end ? pos + bm_pocket->size : f_end;
+
+			int copied = c_end > c_start && bm_pocket->data != NULL;
+
+			if (copied)
+				flatten_copy(bm_data->data + (c_start - va_list.offset), \
+						bm_pocket->data + (c_start - pos), c_end - c_start, nt_copy);
+
+			int whole = copied && c_start == pos && c_end == pos + bm_pocket->size;
+
+			pos = pos + bm_pocket->size;
+
+			if (pos >= f_end && !whole)	// Past the range, or partly outside it
+				break;
+
+			if (whole)	// Only bm_pocket{} copied in full are consumed
+				delete_bm_pocket(bm_bag, &bm_pocket, .ffunc = va_list.ffunc);
+		}
+
+		return bm_data;
+	}
+
+	if (f_size <= 0)
+		return bm_data;
+
+	/* Pick the number of copying threads */
+
+	int n_thread = va_list.n_thread;
+
+	if (n_thread <= 0) {
+		long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+		n_thread = f_size < BM_FLATTEN_MT_SIZE || n_cpu <= 1 ? 1 : (int) n_cpu;
+	}
+
+	n_thread = n_thread < BM_FLATTEN_THREADS ? n_thread : BM_FLATTEN_THREADS;
+	n_thread = f_size / n_thread >= (1L << 20) ? n_thread : 1;
+
+	if (n_thread > 1 && flatten_threaded(bm_bag, va_list.offset, bm_data->data, f_size, \
+			n_thread, nt_copy) == BM_ERROR_NONE)
+		return bm_data;
+
+	/* Single threaded copy from the located bm_pocket{} onwards */
+
+	long p_offset = 0, dst_off = 0, c_size = 0;
+
+	for (struct bm_pocket *bm_pocket = locate_bm_bag(bm_bag, va_list.offset, &p_offset); \
+			bm_pocket != NULL && dst_off < f_size; bm_pocket = bm_pocket->next) {
+		if (bm_pocket->data == NULL || bm_pocket->size <= p_offset) {
+			p_offset = 0;
+			continue;
+		}
+
+		c_size = bm_pocket->size - p_offset < f_size - dst_off ? \
+				bm_pocket->size - p_offset : f_size - dst_off;
+
+		flatten_copy(bm_data->data + dst_off, bm_pocket->data + p_offset, c_size, nt_copy);
+
+		dst_off = dst_off + c_size;
+		p_offset = 0;
+	}
+
+	return bm_data;
+}
@@ -0,0 +1,284 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#define BM_FRAME_VARINT_MAX 10
+#define BM_FRAME_COPY_MAX 256	// Payloads up to this size are copied next to their header
+#define BM_FRAME_COALESCE 65536	// Largest bm_pocket{} built from copied headers and payloads
+
+/* Headers: BM_FRAME_VARINT is LEB128, otherwise a big-endian length of .header bytes */
+
+static int valid_header(int header) {
+	return header == BM_FRAME_VARINT || header == 1 || header == 2 || header == 4 || header == 8;
+}
+
+static int header_size(int header, uint64_t length) {
+	return header == BM_FRAME_VARINT ? varint_size(length) : header;
+}
+
+static void put_header(uint8_t *bytes, int header, uint64_t length) {
+	if (header == BM_FRAME_VARINT) {
+		int_to_varint(length, bytes);
+		return;
+	}
+
+	for (int i = header - 1; i >= 0; i--, length = length >> 8)
+		bytes[i] = length;
+}
+
+static int get_header(uint8_t *bytes, long avail, int header, uint64_t *length) {	// 0 if incomplete, -1 if malformed
+	*length = 0;
+
+	if (header == BM_FRAME_VARINT)
+		return varint_to_int(bytes, avail, length);
+
+	if (avail < header)
+		return 0;
+
+	for (int i = 0; i < header; i++)
+		*length = (*length << 8) | bytes[i];
+
+	return header;
+}
+
+int (parse_bm_frames)(struct bm_data *bm_data, struct bm_data *frames, long *n_frame, \
+		struct parse_bm_frames va_list) {
+	if (bm_data == NULL || n_frame == NULL || *n_frame < 0 || (frames == NULL && *n_frame > 0) || \
+			!valid_header(va_list.header) || (bm_data->data == NULL && bm_data->size > 0)) {
+		va_list.consumed != NULL ? *(va_list.consumed) = 0 : 0;
+		return BM_ERROR_INVAL;
+	}
+
+	uint8_t *bytes = bm_data->data;
+	long at = 0, n = 0;
+	int return_status = BM_ERROR_NONE;
+
+	/* Views into bm_data{}, stop at the first incomplete frame */
+
+	while (n < *n_frame) {
+		uint64_t length;
+		int n_head = get_header(bytes + at, bm_data->size - at, va_list.header, &length);
+
+		if (n_head < 0 || length > (uint64_t) va_list.max_size) {
+			return_status = BM_ERROR_INVAL;
+			break;
+		}
+
+		if (n_head == 0 || length > (uint64_t) (bm_data->size - at - n_head))
+			break;
+
+		frames[n].data = (void*) bytes + at + n_head;
+		frames[n].size = length;
+
+		at = at + n_head + length;
+		n++;
+	}
+
+	*n_frame = n;
+	va_list.consumed != NULL ? *(va_list.consumed) = at : 0;
+
+	return return_status;
+}
+
+/* Byte cursor over the bm_pocket{} of a bm_bag{} */
+
+struct frame_cursor {
+	struct bm_pocket *pocket;
+	long pos;
+};
+
+static void skip_cursor(struct frame_cursor *cursor, long n_byte) {
+	cursor->pos = cursor->pos + n_byte;
+
+	while (cursor->pocket != NULL && cursor->pos >= cursor->pocket->size && \
+			(cursor->pos > cursor->pocket->size || cursor->pocket->next != NULL)) {
+		cursor->pos = cursor->pos - cursor->pocket->size;
+		cursor->pocket = cursor->pocket->next;
+	}
+}
+
+static long peek_cursor(struct frame_cursor *cursor, void *buf, long n_byte) {
+	struct bm_pocket *bm_pocket = cursor->pocket;
+	long pos = cursor->pos, n_copy = 0;
+
+	for ( ; bm_pocket != NULL && n_copy < n_byte; bm_pocket = bm_pocket->next, pos = 0) {
+		long chunk = bm_pocket->size - pos < n_byte - n_copy ? bm_pocket->size - pos : n_byte - n_copy;
+
+		if (chunk > 0) {
+			memcpy(buf + n_copy, bm_pocket->data + pos, chunk);
+			n_copy = n_copy + chunk;
+		}
+	}
+
+	return n_copy;
+}
+
+static int walk_bag_frames(struct bm_bag *bm_bag, struct bm_data *frames, long *n_frame, long *consumed, \
+		long *gathered, struct parse_bm_bag_frames *va_list) {
+	long total = size_bm_bag(bm_bag), at = va_list->offset, n = 0, p_offset = 0;
+	int return_status = BM_ERROR_NONE;
+
+	struct frame_cursor cursor = {.pocket = locate_bm_bag(bm_bag, at, &p_offset), .pos = p_offset};
+	uint8_t head[BM_FRAME_VARINT_MAX];
+
+	*gathered = 0;
+
+	while (n < *n_frame && cursor.pocket != NULL) {
+		uint64_t length;
+		long n_peek = peek_cursor(&cursor, head, va_list->header == BM_FRAME_VARINT ? \
+				BM_FRAME_VARINT_MAX : va_list->header);
+		int n_head = get_header(head, n_peek, va_list->header, &length);
+
+		if (n_head < 0 || length > (uint64_t) va_list->max_size) {
+			return_status = BM_ERROR_INVAL;
+			break;
+		}
+
+		if (n_head == 0 || length > (uint64_t) (total - at - n_head))
+			break;
+
+		struct frame_cursor body = cursor;
+		skip_cursor(&body, n_head);
+
+		/* A payload split across bm_pocket{} is gathered into the scratch bm_buf{} */
+
+		int split = length > 0 && body.pocket->size - body.pos < (long) length;
+
+		if (split && va_list->scratch == NULL)
+			break;
+
+		if (frames != NULL && split) {
+			frames[n].data = va_list->scratch->data + va_list->scratch->size;
+			frames[n].size = peek_cursor(&body, frames[n].data, length);
+			va_list->scratch->size = va_list->scratch->size + length;
+		}
+		else if (frames != NULL) {
+			frames[n].data = length > 0 ? body.pocket->data + body.pos : NULL;
+			frames[n].size = length;
+		}
+
+		*gathered = *gathered + (split ? length : 0);
+
+		skip_cursor(&body, length);
+		cursor = body;
+		at = at + n_head + length;
+		n++;
+	}
+
+	*n_frame = n;
+	*consumed = at - va_list->offset;
+
+	return return_status;
+}
+
+int (parse_bm_bag_frames)(struct bm_bag *bm_bag, struct bm_data *frames, long *n_frame, \
+		struct parse_bm_bag_frames va_list) {
+	if (bm_bag == NULL || n_frame == NULL || *n_frame < 0 || (frames == NULL && *n_frame > 0) || \
+			!valid_header(va_list.header) || va_list.offset < 0) {
+		va_list.consumed != NULL ? *(va_list.consumed) = 0 : 0;
+		return BM_ERROR_INVAL;
+	}
+
+	/* Count first, so the scratch bm_buf{} is grown once and the views into it stay put */
+
+	long n = *n_frame, consumed = 0, gathered = 0;
+	int return_status = walk_bag_frames(bm_bag, NULL, &n, &consumed, &gathered, &va_list);
+
+	if (gathered > 0) {
+		int rs_status = reserve_bm_buf(va_list.scratch, va_list.scratch->size + gathered);
+
+		if (rs_status != BM_ERROR_NONE) {
+			*n_frame = 0;
+			va_list.consumed != NULL ? *(va_list.consumed) = 0 : 0;
+			return rs_status;
+		}
+	}
+
+	if (n > 0)
+		walk_bag_frames(bm_bag, frames, &n, &consumed, &gathered, &va_list);
+
+	*n_frame = n;
+	va_list.consumed != NULL ? *(va_list.consumed) = consumed : 0;
+
+	return return_status;
+}
+
+int (encode_bm_frames)(struct bm_bag *bm_bag, struct bm_data *frames, long n_frame, \
+		struct encode_bm_frames va_list) {
+	if (bm_bag == NULL || n_frame < 0 || (frames == NULL && n_frame > 0) || !valid_header(va_list.header))
+		return BM_ERROR_INVAL;
+
+	for (long i = 0; i < n_frame; i++) {
+		if (frames[i].size < 0 || (frames[i].data == NULL && frames[i].size > 0) || \
+				(va_list.header != BM_FRAME_VARINT && va_list.header < 8 && \
+				(uint64_t) frames[i].size >> (8 * va_list.header) != 0))
+			return BM_ERROR_INVAL;
+	}
+
+	/* Runs of headers and small payloads share one bm_pocket{}, large payloads are borrowed */
+
+	for (long i = 0, j = 0; i < n_frame; i = j) {
+		long size = 0;
+		int borrow = 0;
+
+		for ( ; j < n_frame; j++) {
+			borrow = frames[j].size > BM_FRAME_COPY_MAX;
+
+			long add = header_size(va_list.header, frames[j].size) + (borrow ? 0 : frames[j].size);
+
+			if (size > 0 && size + add > BM_FRAME_COALESCE) {
+				borrow = 0;
+				break;
+			}
+
+			size = size + add;
+
+			if (borrow) {
+				j++;
+				break;
+			}
+		}
+
+		int ap_status = append_bm_pocket(bm_bag, size);
+
+		if (ap_status != BM_ERROR_NONE)
+			return ap_status;
+
+		uint8_t *bytes = bm_bag->end->data;
+
+		for (long k = i; k < j; k++) {
+			put_header(bytes, va_list.header, frames[k].size);
+			bytes = bytes + header_size(va_list.header, frames[k].size);
+
+			if (frames[k].size > BM_FRAME_COPY_MAX)
+				continue;
+
+			if (frames[k].size > 0)
+				memcpy(bytes, frames[k].data, frames[k].size);
+
+			bytes = bytes + frames[k].size;
+		}
+
+		if (borrow && (ap_status = borrow_bm_data(bm_bag, frames + j - 1)) != BM_ERROR_NONE)
+			return ap_status;
+	}
+
+	return BM_ERROR_NONE;
+}
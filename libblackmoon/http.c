@@ -0,0 +1,378 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Stop classes of the byte scanner */
+
+#define BM_HTTP_VALUE 0	// Controls other than HT, and DEL
+#define BM_HTTP_WORD 1	// Controls, SP and DEL
+#define BM_HTTP_NAME 2	// As WORD, plus ':' and bytes above 0x7F
+
+static const uint64_t http_tchar[4] = {0x03FF6CFA00000000ULL, 0x57FFFFFFC7FFFFFEULL, 0, 0};	// RFC 9110 token
+
+static inline int is_tchar(uint8_t c) {
+	return (http_tchar[c >> 6] >> (c & 63)) & 1;
+}
+
+static inline int is_stop(uint8_t c, int class) {
+	if (class == BM_HTTP_VALUE)
+		return (c < 0x20 && c != '\t') || c == 0x7F;
+
+	return c <= 0x20 || c == 0x7F || (class == BM_HTTP_NAME && (c == ':' || c > 0x7F));
+}
+
+static inline __attribute__((always_inline)) const uint8_t* scan_http(const uint8_t *p, const uint8_t *end, int class) {
+#ifdef __SSE2__
+	/* Sixteen bytes per step, the range tests done as unsigned min/max against the bounds */
+
+	const __m128i ctl = _mm_set1_epi8(class == BM_HTTP_VALUE ? 0x1F : 0x20), del = _mm_set1_epi8(0x7F);
+	const __m128i tab = _mm_set1_epi8('\t'), colon = _mm_set1_epi8(':'), high = _mm_set1_epi8((char) 0x80);
+
+	for ( ; end - p >= 16; p = p + 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*) p);
+		__m128i stop = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(x, ctl), x), _mm_cmpeq_epi8(x, del));
+
+		if (class == BM_HTTP_VALUE)
+			stop = _mm_andnot_si128(_mm_cmpeq_epi8(x, tab), stop);
+		else if (class == BM_HTTP_NAME)
+			stop = _mm_or_si128(stop, _mm_or_si128(_mm_cmpeq_epi8(x, colon), \
+					_mm_cmpeq_epi8(_mm_max_epu8(x, high), x)));
+
+		int mask = _mm_movemask_epi8(stop);
+
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+	}
+#endif
+
+	for ( ; p < end && !is_stop(*p, class); p++)
+		;
+
+	return p;
+}
+
+/* A line ends in CRLF, or a bare LF as RFC 9112 lets recipients accept */
+
+static inline const uint8_t* skip_eol(const uint8_t *p, const uint8_t *end) {
+	if (p < end && *p == '\n')
+		return p + 1;
+
+	if (end - p >= 2 && p[0] == '\r' && p[1] == '\n')
+		return p + 2;
+
+	return NULL;
+}
+
+static const uint8_t* parse_version(const uint8_t *p, const uint8_t *end, int *version) {
+	if (end - p < 8 || memcmp(p, "HTTP/1.", 7) != 0 || p[7] < '0' || p[7] > '9')
+		return NULL;
+
+	*version = p[7] - '0';
+
+	return p + 8;
+}
+
+static const uint8_t* parse_start_line(struct bm_http *bm_http, const uint8_t *p, const uint8_t *end, int response) {
+	while (p < end && (*p == '\r' || *p == '\n'))	// Stray empty lines ahead of a message
+		p++;
+
+	if (response) {
+		if ((p = parse_version(p, end, &bm_http->version)) == NULL || end - p < 4 || *p != ' ')
+			return NULL;
+
+		for (int i = 1; i <= 3; i++) {
+			if (p[i] < '0' || p[i] > '9')
+				return NULL;
+		}
+
+		bm_http->status = (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+		p = p + 4;
+
+		const uint8_t *reason = p;
+
+		if (p < end && *p == ' ') {
+			reason = ++p;
+			p = scan_http(p, end, BM_HTTP_VALUE);
+		}
+
+		bm_http->reason.data = (void*) reason;
+		bm_http->reason.size = p - reason;
+
+		return skip_eol(p, end);
+	}
+
+	/* method SP request-target SP HTTP-version */
+
+	const uint8_t *method = p;
+
+	p = scan_http(p, end, BM_HTTP_WORD);
+
+	if (p == method || p >= end || *p != ' ')
+		return NULL;
+
+	for (const uint8_t *c = method; c < p; c++) {
+		if (!is_tchar(*c))
+			return NULL;
+	}
+
+	bm_http->method.data = (void*) method;
+	bm_http->method.size = p - method;
+
+	const uint8_t *target = ++p;
+
+	p = scan_http(p, end, BM_HTTP_WORD);
+
+	if (p == target || p >= end || *p != ' ')
+		return NULL;
+
+	bm_http->target.data = (void*) target;
+	bm_http->target.size = p - target;
+
+	if ((p = parse_version(p + 1, end, &bm_http->version)) == NULL)
+		return NULL;
+
+	return skip_eol(p, end);
+}
+
+static int parse_head(struct bm_http *bm_http, const uint8_t *p, const uint8_t *end, \
+		struct bm_http_header *headers, long *n_header, int response) {
+	if ((p = parse_start_line(bm_http, p, end, response)) == NULL)
+		return BM_ERROR_INVAL;
+
+	long n = 0;
+
+	/* field-name ":" OWS field-value OWS, until the empty line */
+
+	for ( ; ; ) {
+		if (skip_eol(p, end) != NULL)
+			break;
+
+		if (p >= end || *p == ' ' || *p == '\t')	// obs-fold is rejected
+			return BM_ERROR_INVAL;
+
+		const uint8_t *name = p;
+
+		p = scan_http(p, end, BM_HTTP_NAME);
+
+		if (p == name || p >= end || *p != ':')
+			return BM_ERROR_INVAL;
+
+		for (const uint8_t *c = name; c < p; c++) {
+			if (!is_tchar(*c))
+				return BM_ERROR_INVAL;
+		}
+
+		const uint8_t *name_end = p++;
+
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+
+		const uint8_t *value = p;
+
+		p = scan_http(p, end, BM_HTTP_VALUE);
+
+		const uint8_t *value_end = p;
+
+		while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+			value_end--;
+
+		if ((p = skip_eol(p, end)) == NULL)
+			return BM_ERROR_INVAL;
+
+		if (n == *n_header) {
+			bm_http->n_header = n;
+			return BM_ERROR_BUFFER_FULL;
+		}
+
+		headers[n].name.data = (void*) name;
+		headers[n].name.size = name_end - name;
+		headers[n].value.data = (void*) value;
+		headers[n].value.size = value_end - value;
+		n++;
+	}
+
+	*n_header = n;
+	bm_http->n_header = n;
+
+	return BM_ERROR_NONE;
+}
+
+int init_bm_http(struct bm_http *bm_http) {
+	if (bm_http == NULL)
+		return BM_ERROR_INVAL;
+
+	memset(bm_http, 0, sizeof(struct bm_http));
+
+	return BM_ERROR_NONE;
+}
+
+/* End of head: a line feed followed by an empty line, resumed from bm_http{}->scanned */
+
+static long find_head_end(struct bm_http *bm_http, const uint8_t *bytes, long size) {	// 0 if not yet
+	for (long at = bm_http->scanned; at < size; ) {
+		const uint8_t *lf = memchr(bytes + at, '\n', size - at);
+
+		if (lf == NULL) {
+			bm_http->scanned = size;
+			return 0;
+		}
+
+		at = lf - bytes;
+
+		if (size - at < 2 || (lf[1] == '\r' && size - at < 3)) {
+			bm_http->scanned = at;	// Undecided until more bytes arrive
+			return 0;
+		}
+
+		if (lf[1] == '\n')
+			return at + 2;
+
+		if (lf[1] == '\r' && lf[2] == '\n')
+			return at + 3;
+
+		at = at + 1;
+	}
+
+	return 0;
+}
+
+int (parse_bm_http)(struct bm_http *bm_http, struct bm_data *bm_data, struct bm_http_header *headers, \
+		long *n_header, struct parse_bm_http va_list) {
+	if (bm_http == NULL || bm_data == NULL || n_header == NULL || *n_header < 0 || \
+			(headers == NULL && *n_header > 0) || (bm_data->data == NULL && bm_data->size > 0))
+		return BM_ERROR_INVAL;
+
+	if (bm_http->head_size == 0) {
+		bm_http->head_size = find_head_end(bm_http, bm_data->data, bm_data->size);
+
+		if (bm_http->head_size == 0)
+			return bm_http->scanned > va_list.max_head ? BM_ERROR_INVAL : BM_ERROR_RETRY;
+	}
+
+	if (bm_http->head_size > va_list.max_head || bm_http->head_size > bm_data->size)
+		return BM_ERROR_INVAL;
+
+	return parse_head(bm_http, bm_data->data, bm_data->data + bm_http->head_size, headers, n_header, \
+			va_list.response);
+}
+
+static int peek_bytes(struct bm_pocket *bm_pocket, long pos, uint8_t *buf, int n_byte) {
+	int n_peek = 0;
+
+	for ( ; bm_pocket != NULL && n_peek < n_byte; bm_pocket = bm_pocket->next, pos = 0) {
+		for ( ; pos < bm_pocket->size && n_peek < n_byte; pos++)
+			buf[n_peek++] = ((uint8_t*) bm_pocket->data)[pos];
+	}
+
+	return n_peek;
+}
+
+static long find_bag_head_end(struct bm_http *bm_http, struct bm_bag *bm_bag, long offset) {
+	long p_offset = 0, at = bm_http->scanned;
+	struct bm_pocket *bm_pocket = locate_bm_bag(bm_bag, offset + at, &p_offset);
+
+	/* Per bm_pocket{}, peeking into the next ones for the bytes after a line feed */
+
+	for ( ; bm_pocket != NULL; bm_pocket = bm_pocket->next, p_offset = 0) {
+		const uint8_t *bytes = bm_pocket->data;
+
+		while (p_offset < bm_pocket->size) {
+			const uint8_t *lf = memchr(bytes + p_offset, '\n', bm_pocket->size - p_offset);
+
+			if (lf == NULL) {
+				at = at + bm_pocket->size - p_offset;
+				break;
+			}
+
+			at = at + (lf - bytes) - p_offset;
+			p_offset = lf - bytes + 1;
+
+			uint8_t after[2];
+			int n_after = peek_bytes(bm_pocket, p_offset, after, 2);
+
+			if (n_after < 1 || (after[0] == '\r' && n_after < 2)) {
+				bm_http->scanned = at;	// Undecided until more bytes arrive
+				return 0;
+			}
+
+			if (after[0] == '\n')
+				return at + 2;
+
+			if (after[0] == '\r' && after[1] == '\n')
+				return at + 3;
+
+			at = at + 1;
+		}
+	}
+
+	bm_http->scanned = at;
+
+	return 0;
+}
+
+int (parse_bm_http_bag)(struct bm_http *bm_http, struct bm_bag *bm_bag, struct bm_http_header *headers, \
+		long *n_header, struct parse_bm_http_bag va_list) {
+	if (bm_http == NULL || bm_bag == NULL || n_header == NULL || *n_header < 0 || \
+			(headers == NULL && *n_header > 0) || va_list.offset < 0)
+		return BM_ERROR_INVAL;
+
+	if (bm_http->head_size == 0) {
+		bm_http->head_size = find_bag_head_end(bm_http, bm_bag, va_list.offset);
+
+		if (bm_http->head_size == 0)
+			return bm_http->scanned > va_list.max_head ? BM_ERROR_INVAL : BM_ERROR_RETRY;
+	}
+
+	if (bm_http->head_size > va_list.max_head)
+		return BM_ERROR_INVAL;
+
+	/* In place when the head sits in one bm_pocket{}, else gathered into the scratch bm_buf{} */
+
+	long p_offset = 0;
+	struct bm_pocket *bm_pocket = locate_bm_bag(bm_bag, va_list.offset, &p_offset);
+
+	if (bm_pocket == NULL)
+		return BM_ERROR_INVAL;
+
+	if (bm_pocket->size - p_offset >= bm_http->head_size)
+		return parse_head(bm_http, bm_pocket->data + p_offset, bm_pocket->data + p_offset + bm_http->head_size, \
+				headers, n_header, va_list.response);
+
+	if (va_list.scratch == NULL)
+		return BM_ERROR_INVAL;
+
+	int rs_status = reserve_bm_buf(va_list.scratch, va_list.scratch->size + bm_http->head_size);
+
+	if (rs_status != BM_ERROR_NONE)
+		return rs_status;
+
+	uint8_t *head = va_list.scratch->data + va_list.scratch->size;
+
+	if (copy_bm_bag(bm_bag, va_list.offset, head, bm_http->head_size) != bm_http->head_size)
+		return BM_ERROR_INVAL;
+
+	va_list.scratch->size = va_list.scratch->size + bm_http->head_size;
+
+	return parse_head(bm_http, head, head + bm_http->head_size, headers, n_header, va_list.response);
+}
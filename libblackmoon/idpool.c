@@ -0,0 +1,100 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+struct bm_idpool* create_bm_idpool(long n_id) {
+	if (n_id <= 0 || n_id > LONG_MAX - 63)
+		return NULL;
+
+	struct bm_idpool *bm_idpool = calloc(1, sizeof(struct bm_idpool));
+
+	if (bm_idpool == NULL)
+		return NULL;
+
+	bm_idpool->n_word = (n_id + 63) / 64;
+	bm_idpool->n_id = n_id;
+	bm_idpool->word = aligned_alloc(64, ((bm_idpool->n_word * sizeof(uint64_t) + 63) / 64) * 64);
+
+	if (bm_idpool->word == NULL) {
+		free(bm_idpool);
+		return NULL;
+	}
+
+	memset(bm_idpool->word, 0, bm_idpool->n_word * sizeof(uint64_t));
+
+	/* IDs past n_id in the last word are marked taken once, for good */
+
+	if (n_id % 64 != 0)
+		bm_idpool->word[bm_idpool->n_word - 1] = ~0ULL << (n_id % 64);
+
+	return bm_idpool;
+}
+
+long alloc_bm_idpool(struct bm_idpool *bm_idpool) {
+	if (bm_idpool == NULL)
+		return -1;
+
+	/* Start at the word that last had room, spreads threads once it fills */
+
+	long start = __atomic_load_n(&bm_idpool->hint, __ATOMIC_RELAXED);
+
+	for (long i = 0; i < bm_idpool->n_word; i++) {
+		long w = start + i < bm_idpool->n_word ? start + i : start + i - bm_idpool->n_word;
+		uint64_t word = __atomic_load_n(bm_idpool->word + w, __ATOMIC_RELAXED);
+
+		while (~word != 0) {
+			uint64_t mask = 1ULL << __builtin_ctzll(~word);
+
+			word = __atomic_fetch_or(bm_idpool->word + w, mask, __ATOMIC_ACQUIRE);
+
+			if ((word & mask) == 0) {
+				if (w != start)
+					__atomic_store_n(&bm_idpool->hint, w, __ATOMIC_RELAXED);
+
+				return w * 64 + __builtin_ctzll(mask);
+			}
+		}
+	}
+
+	return -1;
+}
+
+int release_bm_idpool(struct bm_idpool *bm_idpool, long id) {
+	if (bm_idpool == NULL || id < 0 || id >= bm_idpool->n_id)
+		return BM_ERROR_INVAL;
+
+	uint64_t mask = 1ULL << (id % 64);
+
+	if ((__atomic_fetch_and(bm_idpool->word + id / 64, ~mask, __ATOMIC_RELEASE) & mask) == 0)
+		return BM_ERROR_INVAL;	// Not allocated
+
+	return BM_ERROR_NONE;
+}
+
+int free_bm_idpool(struct bm_idpool **_bm_idpool) {
+	if (_bm_idpool == NULL || *_bm_idpool == NULL)
+		return BM_ERROR_INVAL;
+
+	free((*_bm_idpool)->word);
+	free(*_bm_idpool);
+	*_bm_idpool = NULL;
+
+	return BM_ERROR_NONE;
+}
@@ -19,6 +19,7 @@
 #include "blackmoon.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 void
 print_hello(){
@@ -29,3 +30,15 @@ int bm_free(void *mem) {
 	free(mem);
 	return BM_ERROR_NONE;
 }
+
+int bm_batch_free(void **mem, long n_mem) {
+	for (long at = 0; at < n_mem; at++)
+		free(mem[at]);
+
+	return BM_ERROR_NONE;
+}
+
+int bm_free_inline(void *mem) {
+	free((char*) mem - offsetof(struct bm_idata, inl));
+	return BM_ERROR_NONE;
+}
@@ -0,0 +1,535 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+/* Block: 8 byte header, then LZ4 style sequences or the raw bytes when they do not shrink */
+
+#define BM_LZ_HEADER 8
+#define BM_LZ_RAW 0x80000000U	// Header flag, payload stored as is
+#define BM_LZ_HASH_LOG 14
+#define BM_LZ_MIN_MATCH 4
+#define BM_LZ_LAST_LITERALS 5	// Sequences end this far from the block end
+#define BM_LZ_MF_LIMIT 12	// No match starts this close to the block end
+#define BM_LZ_MAX_OFFSET 65535
+
+static inline uint32_t load32(const uint8_t *bytes) {
+	uint32_t word;
+	memcpy(&word, bytes, sizeof(word));
+	return word;
+}
+
+static inline uint64_t load64(const uint8_t *bytes) {
+	uint64_t word;
+	memcpy(&word, bytes, sizeof(word));
+	return word;
+}
+
+static inline void put_le32(uint8_t *bytes, uint32_t value) {
+	for (int i = 0; i < 4; i++, value = value >> 8)
+		bytes[i] = value;
+}
+
+static inline uint32_t get_le32(const uint8_t *bytes) {
+	return bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static inline uint32_t lz_hash(uint32_t sequence) {
+	return (sequence * 2654435761U) >> (32 - BM_LZ_HASH_LOG);
+}
+
+static long lz_bound(long size) {
+	return size + size / 255 + 16;
+}
+
+/* Length beyond a 4 bit token field, as a run of 255 and a remainder */
+
+static inline uint8_t* put_length(uint8_t *op, long length) {
+	for ( ; length >= 255; length = length - 255)
+		*op++ = 255;
+
+	*op++ = length;
+
+	return op;
+}
+
+static inline long count_match(const uint8_t *ip, const uint8_t *ref, const uint8_t *limit) {
+	const uint8_t *start = ip;
+
+	while (ip + 8 <= limit) {
+		uint64_t diff = load64(ip) ^ load64(ref);
+
+		if (diff != 0) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			return ip - start + (__builtin_ctzll(diff) >> 3);
+#else
+			return ip - start + (__builtin_clzll(diff) >> 3);
+#endif
+		}
+
+		ip = ip + 8;
+		ref = ref + 8;
+	}
+
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+
+	return ip - start;
+}
+
+static inline uint8_t* put_sequence(uint8_t *op, const uint8_t *anchor, long n_literal, long offset, long match) {
+	uint8_t *token = op++;
+
+	*token = (n_literal < 15 ? n_literal : 15) << 4;
+
+	if (n_literal >= 15)
+		op = put_length(op, n_literal - 15);
+
+	memcpy(op, anchor, n_literal);
+	op = op + n_literal;
+
+	if (match < 0)	// Trailing literals
+		return op;
+
+	*op++ = offset;
+	*op++ = offset >> 8;
+
+	match = match - BM_LZ_MIN_MATCH;
+	*token = *token | (match < 15 ? match : 15);
+
+	if (match >= 15)
+		op = put_length(op, match - 15);
+
+	return op;
+}
+
+static long lz_compress(const uint8_t *src, long size, uint8_t *dst, uint32_t *table) {
+	const uint8_t *ip = src, *anchor = src;
+	const uint8_t *mf_limit = src + size - BM_LZ_MF_LIMIT, *match_limit = src + size - BM_LZ_LAST_LITERALS;
+	uint8_t *op = dst;
+
+	if (size < BM_LZ_MF_LIMIT + 1)
+		return put_sequence(op, anchor, size, 0, -1) - dst;
+
+	memset(table, 0, sizeof(uint32_t) << BM_LZ_HASH_LOG);
+
+	table[lz_hash(load32(ip))] = 0;
+	ip++;
+
+	for ( ; ; ) {
+		/* Find a match, striding further the longer none turns up */
+
+		const uint8_t *ref;
+		long n_miss = 1 << 6;
+
+		for ( ; ; ) {
+			uint32_t h = lz_hash(load32(ip));
+
+			ref = src + table[h];
+			table[h] = ip - src;
+
+			if (ip - ref <= BM_LZ_MAX_OFFSET && load32(ref) == load32(ip) && ref < ip)
+				break;
+
+			ip = ip + (n_miss++ >> 6);
+
+			if (ip > mf_limit)
+				goto last_literals;
+		}
+
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* Emit, then try for an immediate follow up match */
+
+		for ( ; ; ) {
+			long match = BM_LZ_MIN_MATCH + count_match(ip + BM_LZ_MIN_MATCH, ref + BM_LZ_MIN_MATCH, match_limit);
+
+			op = put_sequence(op, anchor, ip - anchor, ip - ref, match);
+			ip = ip + match;
+			anchor = ip;
+
+			if (ip > mf_limit)
+				goto last_literals;
+
+			table[lz_hash(load32(ip - 2))] = ip - 2 - src;
+
+			uint32_t h = lz_hash(load32(ip));
+
+			ref = src + table[h];
+			table[h] = ip - src;
+
+			if (!(ip - ref <= BM_LZ_MAX_OFFSET && load32(ref) == load32(ip) && ref < ip))
+				break;
+		}
+
+		ip++;
+
+		if (ip > mf_limit)
+			break;
+	}
+
+last_literals:
+	return put_sequence(op, anchor, src + size - anchor, 0, -1) - dst;
+}
+
+static long lz_decompress(const uint8_t *src, long size, uint8_t *dst, long cap) {	// -1 if malformed
+	const uint8_t *ip = src, *i_end = src + size;
+	uint8_t *op = dst, *o_end = dst + cap;
+
+	while (ip < i_end) {
+		unsigned int token = *ip++;
+		long n_literal = token >> 4, match = token & 15;
+
+		if (n_literal == 15) {
+			unsigned int byte;
+
+			do {
+				if (ip >= i_end)
+					return -1;
+
+				byte = *ip++;
+				n_literal = n_literal + byte;
+			} while (byte == 255);
+		}
+
+		if (n_literal > i_end - ip || n_literal > o_end - op)
+			return -1;
+
+		if (n_literal <= 16 && i_end - ip >= 16 && o_end - op >= 16)
+			memcpy(op, ip, 16);
+		else
+			memcpy(op, ip, n_literal);
+
+		ip = ip + n_literal;
+		op = op + n_literal;
+
+		if (ip == i_end)
+			break;
+
+		/* Match: offset, then a length that may run on */
+
+		if (i_end - ip < 2)
+			return -1;
+
+		long offset = ip[0] | ip[1] << 8;
+		ip = ip + 2;
+
+		if (offset == 0 || offset > op - dst)
+			return -1;
+
+		if (match == 15) {
+			unsigned int byte;
+
+			do {
+				if (ip >= i_end)
+					return -1;
+
+				byte = *ip++;
+				match = match + byte;
+			} while (byte == 255);
+		}
+
+		match = match + BM_LZ_MIN_MATCH;
+
+		if (match > o_end - op)
+			return -1;
+
+		const uint8_t *ref = op - offset;
+
+		if (offset >= 16 && o_end - op >= match + 16) {	// Whole chunks, overshoot rewritten later
+			memcpy(op, ref, 16);
+
+			for (long at = 16; at < match; at = at + 16)
+				memcpy(op + at, ref + at, 16);
+		}
+		else if (offset >= 8 && o_end - op >= match + 8) {
+			for (long at = 0; at < match; at = at + 8)
+				memcpy(op + at, ref + at, 8);
+		}
+		else {
+			for (long at = 0; at < match; at++)
+				op[at] = ref[at];
+		}
+
+		op = op + match;
+	}
+
+	return op - dst;
+}
+
+struct bm_lz* (create_bm_lz)(struct create_bm_lz va_list) {
+	if (va_list.block_size <= 0 || va_list.block_size > BM_LZ_BLOCK_MAX)
+		return NULL;
+
+	struct bm_lz *bm_lz = calloc(1, sizeof(struct bm_lz));
+
+	if (bm_lz == NULL)
+		return NULL;
+
+	bm_lz->block_size = va_list.block_size;
+	bm_lz->decode = va_list.decode;
+
+	/* Bounded: one staged block, plus the hash table and an output block for compression */
+
+	bm_lz->stage = malloc(va_list.decode ? BM_LZ_HEADER + lz_bound(va_list.block_size) : va_list.block_size);
+
+	if (!va_list.decode) {
+		bm_lz->scratch = malloc(BM_LZ_HEADER + lz_bound(va_list.block_size));
+		bm_lz->table = malloc(sizeof(uint32_t) << BM_LZ_HASH_LOG);
+	}
+
+	if (bm_lz->stage == NULL || (!va_list.decode && (bm_lz->scratch == NULL || bm_lz->table == NULL))) {
+		free_bm_lz(&bm_lz);
+		return NULL;
+	}
+
+	return bm_lz;
+}
+
+static int emit_block(struct bm_lz *bm_lz, const uint8_t *raw, long raw_size, struct bm_bag *dst) {
+	uint8_t *block = bm_lz->scratch;
+	long payload = lz_compress(raw, raw_size, block + BM_LZ_HEADER, bm_lz->table);
+	int stored = payload >= raw_size;
+
+	put_le32(block, (stored ? raw_size : payload) | (stored ? BM_LZ_RAW : 0));
+	put_le32(block + 4, raw_size);
+
+	/* Stored blocks go out as header and raw bytes, without the detour through scratch */
+
+	long size = BM_LZ_HEADER + (stored ? raw_size : payload);
+	int ap_status = append_bm_pocket(dst, size);
+
+	if (ap_status != BM_ERROR_NONE)
+		return ap_status;
+
+	memcpy(dst->end->data, block, BM_LZ_HEADER);
+	memcpy(dst->end->data + BM_LZ_HEADER, stored ? raw : block + BM_LZ_HEADER, size - BM_LZ_HEADER);
+
+	return BM_ERROR_NONE;
+}
+
+int (compress_bm_lz)(struct bm_lz *bm_lz, struct bm_data *bm_data, struct bm_bag *dst, struct compress_bm_lz va_list) {
+	if (bm_lz == NULL || bm_lz->decode || dst == NULL || bm_data == NULL || bm_data->size < 0 || \
+			(bm_data->data == NULL && bm_data->size > 0))
+		return BM_ERROR_INVAL;
+
+	const uint8_t *in = bm_data->data;
+	long size = bm_data->size;
+	int return_status = BM_ERROR_NONE;
+
+	while (size > 0 && return_status == BM_ERROR_NONE) {
+		/* Whole blocks straight from the input, the rest staged until a block fills */
+
+		if (bm_lz->n_stage == 0 && size >= bm_lz->block_size) {
+			return_status = emit_block(bm_lz, in, bm_lz->block_size, dst);
+			in = in + bm_lz->block_size;
+			size = size - bm_lz->block_size;
+			continue;
+		}
+
+		long n_copy = bm_lz->block_size - bm_lz->n_stage < size ? bm_lz->block_size - bm_lz->n_stage : size;
+
+		memcpy(bm_lz->stage + bm_lz->n_stage, in, n_copy);
+		bm_lz->n_stage = bm_lz->n_stage + n_copy;
+		in = in + n_copy;
+		size = size - n_copy;
+
+		if (bm_lz->n_stage == bm_lz->block_size) {
+			return_status = emit_block(bm_lz, bm_lz->stage, bm_lz->n_stage, dst);
+			bm_lz->n_stage = 0;
+		}
+	}
+
+	if (return_status == BM_ERROR_NONE && va_list.flush && bm_lz->n_stage > 0) {
+		return_status = emit_block(bm_lz, bm_lz->stage, bm_lz->n_stage, dst);
+		bm_lz->n_stage = 0;
+	}
+
+	return return_status;
+}
+
+int (compress_bm_lz_bag)(struct bm_lz *bm_lz, struct bm_bag *src, struct bm_bag *dst, struct compress_bm_lz va_list) {
+	if (bm_lz == NULL || src == NULL || dst == NULL || src == dst)
+		return BM_ERROR_INVAL;
+
+	for (struct bm_pocket *bm_pocket = src->start; bm_pocket != NULL; bm_pocket = bm_pocket->next) {
+		struct bm_data bm_data = {.data = bm_pocket->data, .size = bm_pocket->data != NULL ? bm_pocket->size : 0};
+		int cp_status = compress_bm_lz(bm_lz, &bm_data, dst, .flush = va_list.flush && bm_pocket->next == NULL);
+
+		if (cp_status != BM_ERROR_NONE)
+			return cp_status;
+	}
+
+	if (src->start == NULL && va_list.flush) {
+		struct bm_data empty = {.data = NULL, .size = 0};
+		return compress_bm_lz(bm_lz, &empty, dst, .flush = 1);
+	}
+
+	return BM_ERROR_NONE;
+}
+
+static int parse_block(struct bm_lz *bm_lz, const uint8_t *header, long *payload, long *raw_size, int *stored) {
+	uint32_t word = get_le32(header);
+
+	*stored = (word & BM_LZ_RAW) != 0;
+	*payload = word & ~BM_LZ_RAW;
+	*raw_size = get_le32(header + 4);
+
+	if (*raw_size <= 0 || *raw_size > bm_lz->block_size || *payload <= 0 || (*stored && *payload != *raw_size) || \
+			(!*stored && *payload > lz_bound(*raw_size)))
+		return BM_ERROR_INVAL;
+
+	return BM_ERROR_NONE;
+}
+
+static int decode_block(struct bm_lz *bm_lz, const uint8_t *block, struct bm_bag *dst) {
+	long payload, raw_size;
+	int stored;
+
+	if (parse_block(bm_lz, block, &payload, &raw_size, &stored) != BM_ERROR_NONE)
+		return BM_ERROR_INVAL;
+
+	int ap_status = append_bm_pocket(dst, raw_size);
+
+	if (ap_status != BM_ERROR_NONE)
+		return ap_status;
+
+	/* Decoded straight into the new bm_pocket{}, dropped again if the block is corrupt */
+
+	if (stored)
+		memcpy(dst->end->data, block + BM_LZ_HEADER, raw_size);
+	else if (lz_decompress(block + BM_LZ_HEADER, payload, dst->end->data, raw_size) != raw_size) {
+		struct bm_pocket *bm_pocket = dst->end;
+
+		delete_bm_pocket(dst, &bm_pocket);
+		return BM_ERROR_INVAL;
+	}
+
+	return BM_ERROR_NONE;
+}
+
+int (decompress_bm_lz)(struct bm_lz *bm_lz, struct bm_data *bm_data, struct bm_bag *dst, struct decompress_bm_lz va_list) {
+	if (bm_lz == NULL || !bm_lz->decode || dst == NULL || bm_data == NULL || bm_data->size < 0 || \
+			(bm_data->data == NULL && bm_data->size > 0))
+		return BM_ERROR_INVAL;
+
+	const uint8_t *in = bm_data->data;
+	long size = bm_data->size, payload, raw_size;
+	int stored;
+
+	while (size > 0) {
+		/* Blocks wholly inside the input are decoded in place */
+
+		if (bm_lz->n_stage == 0 && size >= BM_LZ_HEADER) {
+			if (parse_block(bm_lz, in, &payload, &raw_size, &stored) != BM_ERROR_NONE)
+				return BM_ERROR_INVAL;
+
+			if (size >= BM_LZ_HEADER + payload) {
+				int dc_status = decode_block(bm_lz, in, dst);
+
+				if (dc_status != BM_ERROR_NONE)
+					return dc_status;
+
+				in = in + BM_LZ_HEADER + payload;
+				size = size - BM_LZ_HEADER - payload;
+				continue;
+			}
+		}
+
+		/* Otherwise stage the header, then the rest of the block once its size is known */
+
+		long need = BM_LZ_HEADER;
+
+		if (bm_lz->n_stage >= BM_LZ_HEADER) {
+			parse_block(bm_lz, bm_lz->stage, &payload, &raw_size, &stored);	// Checked when staged
+			need = BM_LZ_HEADER + payload;
+		}
+
+		long n_copy = need - bm_lz->n_stage < size ? need - bm_lz->n_stage : size;
+
+		memcpy(bm_lz->stage + bm_lz->n_stage, in, n_copy);
+		bm_lz->n_stage = bm_lz->n_stage + n_copy;
+		in = in + n_copy;
+		size = size - n_copy;
+
+		if (bm_lz->n_stage < need)
+			continue;
+
+		if (need == BM_LZ_HEADER) {
+			if (parse_block(bm_lz, bm_lz->stage, &payload, &raw_size, &stored) != BM_ERROR_NONE) {
+				bm_lz->n_stage = 0;
+				return BM_ERROR_INVAL;
+			}
+
+			continue;
+		}
+
+		bm_lz->n_stage = 0;
+
+		int dc_status = decode_block(bm_lz, bm_lz->stage, dst);
+
+		if (dc_status != BM_ERROR_NONE)
+			return dc_status;
+	}
+
+	if (va_list.flush && bm_lz->n_stage > 0) {	// Input ended inside a block
+		bm_lz->n_stage = 0;
+		return BM_ERROR_INVAL;
+	}
+
+	return BM_ERROR_NONE;
+}
+
+int (decompress_bm_lz_bag)(struct bm_lz *bm_lz, struct bm_bag *src, struct bm_bag *dst, struct decompress_bm_lz va_list) {
+	if (bm_lz == NULL || src == NULL || dst == NULL || src == dst)
+		return BM_ERROR_INVAL;
+
+	for (struct bm_pocket *bm_pocket = src->start; bm_pocket != NULL; bm_pocket = bm_pocket->next) {
+		struct bm_data bm_data = {.data = bm_pocket->data, .size = bm_pocket->data != NULL ? bm_pocket->size : 0};
+		int dc_status = decompress_bm_lz(bm_lz, &bm_data, dst, .flush = va_list.flush && bm_pocket->next == NULL);
+
+		if (dc_status != BM_ERROR_NONE)
+			return dc_status;
+	}
+
+	if (src->start == NULL && va_list.flush && bm_lz->n_stage > 0) {
+		bm_lz->n_stage = 0;
+		return BM_ERROR_INVAL;
+	}
+
+	return BM_ERROR_NONE;
+}
+
+int free_bm_lz(struct bm_lz **_bm_lz) {
+	if (_bm_lz == NULL || *_bm_lz == NULL)
+		return BM_ERROR_INVAL;
+
+	free((*_bm_lz)->stage);
+	free((*_bm_lz)->scratch);
+	free((*_bm_lz)->table);
+	free(*_bm_lz);
+	*_bm_lz = NULL;
+
+	return BM_ERROR_NONE;
+}
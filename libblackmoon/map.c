@@ -0,0 +1,378 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define BM_MAP_GROUP 16
+#define BM_MAP_EMPTY ((int8_t) -128)
+#define BM_MAP_DELETED ((int8_t) -2)
+
+/* Hashing, with an ASCII case fold applied eight bytes at a time */
+
+static inline uint64_t bm_map_mix(uint64_t a, uint64_t b) {
+	__uint128_t r = (__uint128_t) a * b;
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t bm_map_fold(uint64_t w) {
+	uint64_t ones = 0x0101010101010101ULL;
+	uint64_t low7 = w & (0x7f * ones);
+	uint64_t upper = ((low7 + (0x80 - 'A') * ones) ^ (low7 + (0x80 - 'Z' - 1) * ones)) & \
+			~w & (0x80 * ones);
+
+	return w | (upper >> 2);
+}
+
+static inline uint64_t bm_map_load(const uint8_t *p, long n) {
+	uint64_t w = 0;
+	memcpy(&w, p, n);
+	return w;
+}
+
+static uint64_t bm_map_hash(const void *data, long size, int nocase) {
+	const uint8_t *p = data;
+	uint64_t h = 0x243f6a8885a308d3ULL ^ ((uint64_t) size * 0x9e3779b97f4a7c15ULL);
+	uint64_t w0, w1;
+	long left = size;
+
+	for ( ; left >= 16; left = left - 16, p = p + 16) {
+		w0 = bm_map_load(p, 8);
+		w1 = bm_map_load(p + 8, 8);
+
+		if (nocase) {
+			w0 = bm_map_fold(w0);
+			w1 = bm_map_fold(w1);
+		}
+
+		h = bm_map_mix(w0 ^ 0xa0761d6478bd642fULL, w1 ^ h);
+	}
+
+	if (left > 0) {
+		w0 = bm_map_load(p, left > 8 ? 8 : left);
+		w1 = left > 8 ? bm_map_load(p + 8, left - 8) : 0;
+
+		if (nocase) {
+			w0 = bm_map_fold(w0);
+			w1 = bm_map_fold(w1);
+		}
+
+		h = bm_map_mix(w0 ^ 0xe7037ed1a0b428dbULL, w1 ^ h);
+	}
+
+	return bm_map_mix(h ^ 0x8ebc6af09c88c6e3ULL, (uint64_t) size ^ 0x589965cc75374cc3ULL);
+}
+
+static int bm_map_equal(struct bm_map *bm_map, struct bm_data *a, struct bm_data *b) {
+	if (a->size != b->size)
+		return 0;
+
+	if (!bm_map->nocase)
+		return a->size == 0 || memcmp(a->data, b->data, a->size) == 0;
+
+	const uint8_t *p = a->data, *q = b->data;
+	long at = 0;
+
+	for ( ; at + 8 <= a->size; at = at + 8) {
+		if (bm_map_fold(bm_map_load(p + at, 8)) != bm_map_fold(bm_map_load(q + at, 8)))
+			return 0;
+	}
+
+	return at == a->size || bm_map_fold(bm_map_load(p + at, a->size - at)) == \
+			bm_map_fold(bm_map_load(q + at, a->size - at));
+}
+
+/* Control byte groups, bit i of a mask stands for slot pos + i */
+
+static inline uint32_t bm_map_match(int8_t *ctrl, int8_t h2) {
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((__m128i*) ctrl);
+	return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+#else
+	uint32_t mask = 0;
+
+	for (int at = 0; at < BM_MAP_GROUP; at++)
+		mask = mask | ((uint32_t) (ctrl[at] == h2) << at);
+
+	return mask;
+#endif
+}
+
+static inline uint32_t bm_map_match_free(int8_t *ctrl) {
+#ifdef __SSE2__
+	/* EMPTY and DELETED are the only control bytes with the sign bit set */
+
+	return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((__m128i*) ctrl));
+#else
+	uint32_t mask = 0;
+
+	for (int at = 0; at < BM_MAP_GROUP; at++)
+		mask = mask | ((uint32_t) (ctrl[at] < 0) << at);
+
+	return mask;
+#endif
+}
+
+static inline void bm_map_set_ctrl(struct bm_map *bm_map, long pos, int8_t h) {
+	bm_map->ctrl[pos] = h;
+	bm_map->ctrl[((pos - BM_MAP_GROUP) & (bm_map->cap - 1)) + BM_MAP_GROUP] = h;
+}
+
+static long bm_map_find(struct bm_map *bm_map, struct bm_data *key, uint64_t hash) {
+	long mask = bm_map->cap - 1, pos = (hash >> 7) & mask, stride = 0;
+	int8_t h2 = hash & 0x7f;
+
+	for ( ; ; ) {
+		for (uint32_t match = bm_map_match(bm_map->ctrl + pos, h2); match != 0; \
+				match = match & (match - 1)) {
+			long at = (pos + __builtin_ctz(match)) & mask;
+
+			if (bm_map_equal(bm_map, &bm_map->slot[at].key, key))
+				return at;
+		}
+
+		if (bm_map_match(bm_map->ctrl + pos, BM_MAP_EMPTY) != 0)
+			return -1;
+
+		stride = stride + BM_MAP_GROUP;
+		pos = (pos + stride) & mask;
+	}
+}
+
+static long bm_map_find_free(struct bm_map *bm_map, uint64_t hash) {
+	long mask = bm_map->cap - 1, pos = (hash >> 7) & mask, stride = 0;
+
+	for ( ; ; ) {
+		uint32_t match = bm_map_match_free(bm_map->ctrl + pos);
+
+		if (match != 0)
+			return (pos + __builtin_ctz(match)) & mask;
+
+		stride = stride + BM_MAP_GROUP;
+		pos = (pos + stride) & mask;
+	}
+}
+
+static int bm_map_resize(struct bm_map *bm_map, long cap) {
+	int8_t *ctrl = malloc(cap + BM_MAP_GROUP);
+	struct bm_map_slot *slot = malloc(cap * sizeof(struct bm_map_slot));
+
+	if (ctrl == NULL || slot == NULL) {
+		free(ctrl);
+		free(slot);
+		return BM_ERROR_FATAL;
+	}
+
+	memset(ctrl, BM_MAP_EMPTY, cap + BM_MAP_GROUP);
+
+	/* Move the live entries over, dropping the tombstones */
+
+	int8_t *o_ctrl = bm_map->ctrl;
+	struct bm_map_slot *o_slot = bm_map->slot;
+	long o_cap = bm_map->cap;
+
+	bm_map->ctrl = ctrl;
+	bm_map->slot = slot;
+	bm_map->cap = cap;
+
+	for (long at = 0; at < o_cap; at++) {
+		if (o_ctrl[at] < 0)
+			continue;
+
+		uint64_t hash = bm_map_hash(o_slot[at].key.data, o_slot[at].key.size, bm_map->nocase);
+		long pos = bm_map_find_free(bm_map, hash);
+
+		bm_map_set_ctrl(bm_map, pos, hash & 0x7f);
+		slot[pos] = o_slot[at];
+	}
+
+	bm_map->growth_left = cap - cap / 8 - bm_map->n_entry;
+
+	free(o_ctrl);
+	free(o_slot);
+
+	return BM_ERROR_NONE;
+}
+
+struct bm_map* (create_bm_map)(struct create_bm_map va_list) {
+	struct bm_map *bm_map = calloc(1, sizeof(struct bm_map));
+
+	if (bm_map == NULL)
+		return NULL;
+
+	bm_map->nocase = va_list.nocase;
+	bm_map->ffunc = va_list.ffunc;
+
+	if (reserve_bm_map(bm_map, va_list.n_entry) != BM_ERROR_NONE) {
+		free(bm_map);
+		return NULL;
+	}
+
+	return bm_map;
+}
+
+int reserve_bm_map(struct bm_map *bm_map, long n_entry) {
+	if (bm_map == NULL || n_entry < 0 || n_entry > LONG_MAX / 16)
+		return BM_ERROR_INVAL;
+
+	/* Keep the load factor at or below 7/8 */
+
+	long cap = BM_MAP_GROUP;
+
+	while (cap - cap / 8 < n_entry)
+		cap = cap << 1;
+
+	if (bm_map->ctrl != NULL && cap <= bm_map->cap)
+		return BM_ERROR_NONE;
+
+	return bm_map_resize(bm_map, cap);
+}
+
+static void bm_map_drop(struct bm_map *bm_map, struct bm_data *bm_data) {
+	if (bm_map->ffunc != NULL && bm_data->data != NULL)
+		(*(bm_map->ffunc))(bm_data->data);
+}
+
+int put_bm_map(struct bm_map *bm_map, struct bm_data *key, struct bm_data *value) {
+	if (bm_map == NULL || key == NULL || value == NULL || key->size < 0 || \
+			(key->data == NULL && key->size > 0))
+		return BM_ERROR_INVAL;
+
+	uint64_t hash = bm_map_hash(key->data, key->size, bm_map->nocase);
+	long pos = bm_map_find(bm_map, key, hash);
+
+	if (pos >= 0) {	// Replace the value, the stored key stays
+		if (value->data != bm_map->slot[pos].value.data)
+			bm_map_drop(bm_map, &bm_map->slot[pos].value);
+
+		if (key->data != bm_map->slot[pos].key.data)
+			bm_map_drop(bm_map, key);
+
+		bm_map->slot[pos].value = *value;
+
+		return BM_ERROR_NONE;
+	}
+
+	pos = bm_map_find_free(bm_map, hash);
+
+	if (bm_map->ctrl[pos] == BM_MAP_EMPTY && bm_map->growth_left == 0) {
+		/* Rehash in place if tombstones eat the space, otherwise grow */
+
+		long cap = bm_map->n_entry + 1 > (bm_map->cap - bm_map->cap / 8) / 2 ? \
+				bm_map->cap << 1 : bm_map->cap;
+
+		if (bm_map_resize(bm_map, cap) != BM_ERROR_NONE)
+			return BM_ERROR_FATAL;
+
+		pos = bm_map_find_free(bm_map, hash);
+	}
+
+	if (bm_map->ctrl[pos] == BM_MAP_EMPTY)
+		bm_map->growth_left = bm_map->growth_left - 1;
+
+	bm_map_set_ctrl(bm_map, pos, hash & 0x7f);
+	bm_map->slot[pos].key = *key;
+	bm_map->slot[pos].value = *value;
+	bm_map->n_entry = bm_map->n_entry + 1;
+
+	return BM_ERROR_NONE;
+}
+
+int fill_bm_map(struct bm_map *bm_map, struct bm_data *keys, struct bm_data *values, long n_entry) {
+	if (bm_map == NULL || keys == NULL || values == NULL || n_entry < 0)
+		return BM_ERROR_INVAL;
+
+	int fm_status = reserve_bm_map(bm_map, bm_map->n_entry + n_entry);
+
+	for (long at = 0; at < n_entry && fm_status == BM_ERROR_NONE; at++)
+		fm_status = put_bm_map(bm_map, keys + at, values + at);
+
+	return fm_status;
+}
+
+struct bm_data* get_bm_map(struct bm_map *bm_map, struct bm_data *key) {
+	if (bm_map == NULL || key == NULL || key->size < 0 || (key->data == NULL && key->size > 0))
+		return NULL;
+
+	long pos = bm_map_find(bm_map, key, bm_map_hash(key->data, key->size, bm_map->nocase));
+
+	return pos >= 0 ? &bm_map->slot[pos].value : NULL;
+}
+
+int delete_bm_map(struct bm_map *bm_map, struct bm_data *key) {
+	if (bm_map == NULL || key == NULL || key->size < 0 || (key->data == NULL && key->size > 0))
+		return BM_ERROR_INVAL;
+
+	long pos = bm_map_find(bm_map, key, bm_map_hash(key->data, key->size, bm_map->nocase));
+
+	if (pos < 0)
+		return BM_ERROR_INVAL;
+
+	bm_map_drop(bm_map, &bm_map->slot[pos].key);
+	bm_map_drop(bm_map, &bm_map->slot[pos].value);
+
+	bm_map_set_ctrl(bm_map, pos, BM_MAP_DELETED);
+	bm_map->n_entry = bm_map->n_entry - 1;
+
+	return BM_ERROR_NONE;
+}
+
+int next_bm_map(struct bm_map *bm_map, long *iter, struct bm_data **key, struct bm_data **value) {
+	if (bm_map == NULL || iter == NULL || *iter < 0)
+		return BM_ERROR_INVAL;
+
+	for ( ; *iter < bm_map->cap; *iter = *iter + 1) {
+		if (bm_map->ctrl[*iter] < 0)
+			continue;
+
+		key != NULL ? *key = &bm_map->slot[*iter].key : 0;
+		value != NULL ? *value = &bm_map->slot[*iter].value : 0;
+		*iter = *iter + 1;
+
+		return BM_ERROR_NONE;
+	}
+
+	return BM_ERROR_INVAL;
+}
+
+int free_bm_map(struct bm_map **_bm_map) {
+	if (_bm_map == NULL || *_bm_map == NULL)
+		return BM_ERROR_INVAL;
+
+	struct bm_map *bm_map = *_bm_map;
+
+	for (long at = 0; bm_map->ffunc != NULL && at < bm_map->cap; at++) {
+		if (bm_map->ctrl[at] < 0)
+			continue;
+
+		bm_map_drop(bm_map, &bm_map->slot[at].key);
+		bm_map_drop(bm_map, &bm_map->slot[at].value);
+	}
+
+	free(bm_map->ctrl);
+	free(bm_map->slot);
+	free(bm_map);
+	*_bm_map = NULL;
+
+	return BM_ERROR_NONE;
+}
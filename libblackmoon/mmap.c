@@ -0,0 +1,136 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#define _GNU_SOURCE
+#include "blackmoon.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BM_HUGEPAGE_SIZE (2L << 20)
+
+struct bm_mapping {	// Lives in the page right before the mapped data
+	long m_size;
+};
+
+struct bm_data* (map_bm_data)(char *path, struct map_bm_data va_list) {
+	if (path == NULL)
+		return NULL;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return NULL;
+
+	struct stat f_stat;
+
+	if (fstat(fd, &f_stat) < 0 || !S_ISREG(f_stat.st_mode)) {
+		close(fd);
+		return NULL;
+	}
+
+	struct bm_data *bm_data = calloc(1, sizeof(struct bm_data));
+
+	if (bm_data == NULL || f_stat.st_size == 0) {
+		close(fd);
+		return bm_data;
+	}
+
+	/* Reserve a header page, the data and a zero page after it, aligned for huge pages if asked */
+
+	long page = sysconf(_SC_PAGESIZE);
+	long align = va_list.hugepage ? BM_HUGEPAGE_SIZE : page;
+	long d_size = (f_stat.st_size + page - 1) & ~(page - 1);
+	long r_size = page + d_size + page + align;
+
+	void *base = mmap(NULL, r_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (base == MAP_FAILED)
+		goto map_error;
+
+	void *data = (void*) (((uintptr_t) base + page + align - 1) & ~((uintptr_t) align - 1));
+	struct bm_mapping *bm_mapping = data - page;
+
+	/* Trim the reservation down to [header page, zero page end), the zero page NUL-terminates the data */
+
+	if ((void*) bm_mapping > base)
+		munmap(base, (void*) bm_mapping - base);
+
+	if (base + r_size > data + d_size + page)
+		munmap(data + d_size + page, (base + r_size) - (data + d_size + page));
+
+	mprotect(data + d_size, page, PROT_READ);
+
+	/* Map the file over the data part of the reservation */
+
+	int m_flags = (va_list.private ? MAP_PRIVATE : MAP_SHARED) | MAP_FIXED | \
+			(va_list.populate ? MAP_POPULATE : 0);
+	int m_prot = va_list.private ? PROT_READ | PROT_WRITE : PROT_READ;
+
+	if (mmap(data, f_stat.st_size, m_prot, m_flags, fd, 0) == MAP_FAILED) {
+		munmap(bm_mapping, page + d_size + page);
+		goto map_error;
+	}
+
+	close(fd);
+
+	bm_mapping->m_size = page + d_size + page;
+
+	/* Access pattern hints, failures are not fatal */
+
+	if (va_list.sequential)
+		madvise(data, d_size, MADV_SEQUENTIAL);
+
+	if (va_list.willneed)
+		madvise(data, d_size, MADV_WILLNEED);
+
+#ifdef MADV_HUGEPAGE
+	if (va_list.hugepage)
+		madvise(data, d_size, MADV_HUGEPAGE);
+#endif
+
+	bm_data->data = data;
+	bm_data->size = f_stat.st_size;
+
+	return bm_data;
+
+map_error:
+
+	close(fd);
+	free(bm_data);
+
+	return NULL;
+}
+
+int bm_munmap(void *mem) {
+	if (mem == NULL)
+		return BM_ERROR_NONE;
+
+	struct bm_mapping *bm_mapping = mem - sysconf(_SC_PAGESIZE);
+
+	if (munmap(bm_mapping, bm_mapping->m_size) < 0)
+		return BM_ERROR_INVAL;
+
+	return BM_ERROR_NONE;
+}
+
+int unmap_bm_data(struct bm_data **_bm_data) {
+	return free_bm_data(_bm_data, .ffunc = bm_munmap);
+}
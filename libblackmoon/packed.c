@@ -0,0 +1,347 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BM_PACKED_X86
+#endif
+
+/* Slack past the last element, so kernels may load whole words unchecked */
+
+#define BM_PACKED_SLACK 16
+
+static inline __attribute__((always_inline)) uint64_t load_be64(const uint8_t *bytes) {
+	uint64_t word;
+
+	memcpy(&word, bytes, sizeof(word));
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	return word;
+}
+
+static inline __attribute__((always_inline)) void store_be64(uint8_t *bytes, uint64_t word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	memcpy(bytes, &word, sizeof(word));
+}
+
+static inline __attribute__((always_inline)) uint64_t width_mask(int width) {
+	return width == 64 ? ~0ULL : (1ULL << width) - 1;
+}
+
+/* Field of width bits starting r (< 8) bits into bytes, spans at most nine bytes */
+
+static inline __attribute__((always_inline)) uint64_t extract_field(const uint8_t *bytes, int r, int width) {
+	uint64_t word = load_be64(bytes) << r;
+
+	if (r + width > 64)
+		word = word | (bytes[8] >> (8 - r));
+
+	return word >> (64 - width);
+}
+
+static inline __attribute__((always_inline)) void insert_field(uint8_t *bytes, int r, int width, uint64_t value) {
+	value = value & width_mask(width);
+
+	if (r + width <= 64) {
+		int shift = 64 - r - width;
+		uint64_t mask = width_mask(width) << shift;
+
+		store_be64(bytes, (load_be64(bytes) & ~mask) | (value << shift));
+		return;
+	}
+
+	int k = r + width - 64;	// Bits spilling into the ninth byte
+
+	store_be64(bytes, (load_be64(bytes) & ~(~0ULL >> r)) | (value >> k));
+	bytes[8] = (bytes[8] & (0xFF >> k)) | (uint8_t) (value << (8 - k));
+}
+
+/* Unpack kernels: eight elements span exactly width bytes, so offsets within a group are constants */
+
+static inline __attribute__((always_inline)) void unpack_groups(const uint8_t *bytes, long n_group, \
+		uint64_t *values64, uint32_t *values32, int width) {
+	if (values64 != NULL) {
+		for (long g = 0; g < n_group; g++, bytes = bytes + width) {
+#pragma GCC unroll 8
+			for (int j = 0; j < 8; j++)
+				values64[g * 8 + j] = extract_field(bytes + j * width / 8, j * width % 8, width);
+		}
+
+		return;
+	}
+
+	for (long g = 0; g < n_group; g++, bytes = bytes + width) {
+#pragma GCC unroll 8
+		for (int j = 0; j < 8; j++)
+			values32[g * 8 + j] = extract_field(bytes + j * width / 8, j * width % 8, width);
+	}
+}
+
+typedef void (unpack_kernel)(const uint8_t*, long, uint64_t*, uint32_t*);
+
+#define BM_PACKED_KERNEL(width) \
+	static void unpack_w##width(const uint8_t *bytes, long n_group, uint64_t *values64, uint32_t *values32) { \
+		unpack_groups(bytes, n_group, values64, values32, width); \
+	}
+
+#define BM_PACKED_WIDTHS(X) \
+	X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) \
+	X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31) X(32) \
+	X(33) X(34) X(35) X(36) X(37) X(38) X(39) X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) X(48) \
+	X(49) X(50) X(51) X(52) X(53) X(54) X(55) X(56) X(57) X(58) X(59) X(60) X(61) X(62) X(63) X(64)
+
+BM_PACKED_WIDTHS(BM_PACKED_KERNEL)
+
+#define BM_PACKED_ENTRY(width) unpack_w##width,
+
+static unpack_kernel * const unpack_kernels[65] = {NULL, BM_PACKED_WIDTHS(BM_PACKED_ENTRY)};
+
+#ifdef BM_PACKED_X86
+__attribute__((target("avx2")))
+static void unpack_gather_avx2(const uint8_t *bytes, long n_group, uint32_t *values, int width) {
+	/* One 32 bit gather per group, byte swapped, shifted to the top and down to the width */
+
+	int off[8], shl[8];
+
+	for (int j = 0; j < 8; j++) {
+		off[j] = j * width / 8;
+		shl[j] = j * width % 8;
+	}
+
+	const __m256i v_off = _mm256_loadu_si256((const __m256i*) off);
+	const __m256i v_shl = _mm256_loadu_si256((const __m256i*) shl);
+	const __m128i v_shr = _mm_cvtsi32_si128(32 - width);
+	const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, \
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+	for (long g = 0; g < n_group; g++, bytes = bytes + width) {
+		__m256i v = _mm256_i32gather_epi32((const int*) bytes, v_off, 1);
+
+		v = _mm256_shuffle_epi8(v, bswap);
+		v = _mm256_srl_epi32(_mm256_sllv_epi32(v, v_shl), v_shr);
+
+		_mm256_storeu_si256((__m256i*) (values + g * 8), v);
+	}
+}
+#endif
+
+struct bm_packed* (create_bm_packed)(int width, struct create_bm_packed va_list) {
+	if (width < 1 || width > 64 || va_list.n_elem < 0)
+		return NULL;
+
+	struct bm_packed *bm_packed = calloc(1, sizeof(struct bm_packed));
+
+	if (bm_packed == NULL)
+		return NULL;
+
+	bm_packed->width = width;
+
+	if (reserve_bm_packed(bm_packed, va_list.n_elem) != BM_ERROR_NONE) {
+		free(bm_packed);
+		return NULL;
+	}
+
+	return bm_packed;
+}
+
+int reserve_bm_packed(struct bm_packed *bm_packed, long n_elem) {
+	if (bm_packed == NULL || n_elem < 0 || n_elem > (LONG_MAX - BM_PACKED_SLACK * 8) / 64)
+		return BM_ERROR_INVAL;
+
+	if (n_elem <= bm_packed->cap && bm_packed->data != NULL)
+		return BM_ERROR_NONE;
+
+	long old_size = bm_packed->data == NULL ? 0 : (bm_packed->cap * bm_packed->width + 7) / 8 + BM_PACKED_SLACK;
+	long new_size = (n_elem * bm_packed->width + 7) / 8 + BM_PACKED_SLACK;
+	uint8_t *data = realloc(bm_packed->data, new_size);
+
+	if (data == NULL)
+		return BM_ERROR_FATAL;
+
+	memset(data + old_size, 0, new_size - old_size);
+
+	bm_packed->data = data;
+	bm_packed->cap = n_elem;
+
+	return BM_ERROR_NONE;
+}
+
+uint64_t get_bm_packed(struct bm_packed *bm_packed, long at) {
+	if (bm_packed == NULL || at < 0 || at >= bm_packed->size)
+		return 0;
+
+	unsigned long bit_pos = (unsigned long) at * bm_packed->width;
+
+	return extract_field(bm_packed->data + bit_pos / 8, bit_pos % 8, bm_packed->width);
+}
+
+int set_bm_packed(struct bm_packed *bm_packed, long at, uint64_t value) {
+	if (bm_packed == NULL || at < 0 || at >= bm_packed->size)
+		return BM_ERROR_INVAL;
+
+	unsigned long bit_pos = (unsigned long) at * bm_packed->width;
+
+	insert_field(bm_packed->data + bit_pos / 8, bit_pos % 8, bm_packed->width, value);
+
+	return BM_ERROR_NONE;
+}
+
+int append_bm_packed(struct bm_packed *bm_packed, uint64_t value) {
+	if (bm_packed == NULL)
+		return BM_ERROR_INVAL;
+
+	if (bm_packed->size == bm_packed->cap) {
+		int rs_status = reserve_bm_packed(bm_packed, bm_packed->cap < 8 ? 16 : bm_packed->cap * 2);
+
+		if (rs_status != BM_ERROR_NONE)
+			return rs_status;
+	}
+
+	bm_packed->size = bm_packed->size + 1;
+
+	return set_bm_packed(bm_packed, bm_packed->size - 1, value);
+}
+
+static int unpack_range(struct bm_packed *bm_packed, long at, long n, uint64_t *values64, uint32_t *values32) {
+	if (bm_packed == NULL || at < 0 || n < 0 || n > bm_packed->size - at || \
+			(values64 == NULL && values32 == NULL))
+		return BM_ERROR_INVAL;
+
+	int width = bm_packed->width;
+	long i = 0;
+
+	/* Single elements up to a group boundary, then whole groups, then the tail */
+
+	for ( ; i < n && (at + i) % 8 != 0; i++) {
+		uint64_t value = get_bm_packed(bm_packed, at + i);
+		values64 != NULL ? values64[i] = value : (values32[i] = value);
+	}
+
+	long n_group = (n - i) / 8;
+	const uint8_t *bytes = bm_packed->data + (at + i) / 8 * width;
+
+	if (n_group > 0) {
+#ifdef BM_PACKED_X86
+		if (values32 != NULL && width <= 25 && __builtin_cpu_supports("avx2"))
+			unpack_gather_avx2(bytes, n_group, values32 + i, width);
+		else
+#endif
+			unpack_kernels[width](bytes, n_group, values64 != NULL ? values64 + i : NULL, \
+					values32 != NULL ? values32 + i : NULL);
+
+		i = i + n_group * 8;
+	}
+
+	for ( ; i < n; i++) {
+		uint64_t value = get_bm_packed(bm_packed, at + i);
+		values64 != NULL ? values64[i] = value : (values32[i] = value);
+	}
+
+	return BM_ERROR_NONE;
+}
+
+int unpack_bm_packed(struct bm_packed *bm_packed, long at, long n, uint64_t *values) {
+	return unpack_range(bm_packed, at, n, values, NULL);
+}
+
+int unpack32_bm_packed(struct bm_packed *bm_packed, long at, long n, uint32_t *values) {
+	if (bm_packed != NULL && bm_packed->width > 32)
+		return BM_ERROR_INVAL;
+
+	return unpack_range(bm_packed, at, n, NULL, values);
+}
+
+static int pack_range(struct bm_packed *bm_packed, long at, long n, uint64_t *values64, uint32_t *values32) {
+	if (bm_packed == NULL || at < 0 || n < 0 || at > bm_packed->size || n > LONG_MAX - at || \
+			(values64 == NULL && values32 == NULL && n > 0))
+		return BM_ERROR_INVAL;
+
+	/* Packing past the end grows the vector */
+
+	if (at + n > bm_packed->cap) {
+		int rs_status = reserve_bm_packed(bm_packed, at + n);
+
+		if (rs_status != BM_ERROR_NONE)
+			return rs_status;
+	}
+
+	bm_packed->size = at + n > bm_packed->size ? at + n : bm_packed->size;
+
+	int width = bm_packed->width;
+	long i = 0;
+
+	for ( ; i < n && (at + i) % 8 != 0; i++)
+		set_bm_packed(bm_packed, at + i, values64 != NULL ? values64[i] : values32[i]);
+
+	/* Whole groups cover whole bytes, stream them out through an accumulator */
+
+	long n_full = (n - i) / 8 * 8;
+	uint8_t *bytes = bm_packed->data + (at + i) / 8 * width;
+	uint64_t acc = 0, value;
+	int n_acc = 0;
+
+	for (long end = i + n_full; i < end; i++) {
+		value = (values64 != NULL ? values64[i] : values32[i]) & width_mask(width);
+
+		for (int part = width > 32 ? width - 32 : width, left = width; left > 0; left = left - part, part = left) {
+			if (n_acc + part > 64) {
+				for ( ; n_acc >= 8; n_acc = n_acc - 8, acc = acc << 8)
+					*bytes++ = acc >> 56;
+			}
+
+			acc = acc | (((value >> (left - part)) & width_mask(part)) << (64 - n_acc - part));
+			n_acc = n_acc + part;
+		}
+	}
+
+	for ( ; n_acc > 0; n_acc = n_acc - 8, acc = acc << 8)
+		*bytes++ = acc >> 56;
+
+	for ( ; i < n; i++)
+		set_bm_packed(bm_packed, at + i, values64 != NULL ? values64[i] : values32[i]);
+
+	return BM_ERROR_NONE;
+}
+
+int pack_bm_packed(struct bm_packed *bm_packed, long at, uint64_t *values, long n) {
+	return pack_range(bm_packed, at, n, values, NULL);
+}
+
+int pack32_bm_packed(struct bm_packed *bm_packed, long at, uint32_t *values, long n) {
+	return pack_range(bm_packed, at, n, NULL, values);
+}
+
+int free_bm_packed(struct bm_packed **_bm_packed) {
+	if (_bm_packed == NULL || *_bm_packed == NULL)
+		return BM_ERROR_INVAL;
+
+	free((*_bm_packed)->data);
+	free(*_bm_packed);
+	*_bm_packed = NULL;
+
+	return BM_ERROR_NONE;
+}
@@ -0,0 +1,230 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+struct bm_ring* create_bm_ring(long bm_ring_size) {
+	if (bm_ring_size <= 0 || bm_ring_size > LONG_MAX / 2)
+		return NULL;
+
+	struct bm_ring *bm_ring = aligned_alloc(64, sizeof(struct bm_ring));
+
+	if (bm_ring == NULL)
+		return NULL;
+
+	memset(bm_ring, 0, sizeof(struct bm_ring));
+
+	/* Round the slot count up to a power of two */
+
+	long n_slot = 1;
+
+	while (n_slot < bm_ring_size)
+		n_slot = n_slot << 1;
+
+	bm_ring->slot = calloc(n_slot, sizeof(struct bm_pocket*));
+
+	if (bm_ring->slot == NULL) {
+		free(bm_ring);
+		return NULL;
+	}
+
+	bm_ring->mask = n_slot - 1;
+
+	return bm_ring;
+}
+
+int push_bm_ring(struct bm_ring *bm_ring, struct bm_pocket *bm_pocket) {
+	if (bm_ring == NULL || bm_pocket == NULL)
+		return BM_ERROR_INVAL;
+
+	long tail = bm_ring->tail;
+
+	/* Refresh the cached consumer position only when the bm_ring{} looks full */
+
+	if (tail - bm_ring->c_head > bm_ring->mask) {
+		bm_ring->c_head = __atomic_load_n(&bm_ring->head, __ATOMIC_ACQUIRE);
+
+		if (tail - bm_ring->c_head > bm_ring->mask)
+			return BM_ERROR_BUFFER_FULL;
+	}
+
+	bm_ring->slot[tail & bm_ring->mask] = bm_pocket;
+	__atomic_store_n(&bm_ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return BM_ERROR_NONE;
+}
+
+long pop_bm_ring(struct bm_ring *bm_ring, struct bm_pocket **bm_pockets, long n_pkt) {
+	if (bm_ring == NULL || bm_pockets == NULL || n_pkt <= 0)
+		return 0;
+
+	long head = bm_ring->head;
+
+	if (bm_ring->c_tail - head < n_pkt)
+		bm_ring->c_tail = __atomic_load_n(&bm_ring->tail, __ATOMIC_ACQUIRE);
+
+	/* Take as many bm_pocket{} as are available, up to n_pkt */
+
+	long n_pop = bm_ring->c_tail - head < n_pkt ? bm_ring->c_tail - head : n_pkt;
+
+	for (long pkt_count = 0; pkt_count < n_pop; pkt_count++)
+		bm_pockets[pkt_count] = bm_ring->slot[(head + pkt_count) & bm_ring->mask];
+
+	if (n_pop > 0)
+		__atomic_store_n(&bm_ring->head, head + n_pop, __ATOMIC_RELEASE);
+
+	return n_pop;
+}
+
+int (free_bm_ring)(struct bm_ring **_bm_ring, struct free_bm_ring va_list) {
+	if (_bm_ring == NULL || *_bm_ring == NULL)
+		return BM_ERROR_INVAL;
+
+	/* Hand the leftover bm_pocket{} to a bm_bag{} and free them there */
+
+	struct bm_bag *bm_bag = create_bm_bag();
+
+	if (bm_bag == NULL)
+		return BM_ERROR_FATAL;
+
+	struct bm_pocket *bm_pocket = NULL;
+
+	while (pop_bm_ring(*_bm_ring, &bm_pocket, 1) == 1)
+		attach_bm_pocket(bm_bag, bm_pocket);
+
+	int fr_status = free_bm_bag(&bm_bag, .ffunc = va_list.ffunc);
+
+	free((*_bm_ring)->slot);
+	free(*_bm_ring);
+	*_bm_ring = NULL;
+
+	return fr_status;
+}
+
+struct bm_mpsc* create_bm_mpsc() {
+	struct bm_mpsc *bm_mpsc = aligned_alloc(64, sizeof(struct bm_mpsc));
+
+	if (bm_mpsc == NULL)
+		return NULL;
+
+	bm_mpsc->stub = calloc(1, sizeof(struct bm_pocket));
+
+	if (bm_mpsc->stub == NULL) {
+		free(bm_mpsc);
+		return NULL;
+	}
+
+	bm_mpsc->head = bm_mpsc->stub;
+	bm_mpsc->tail = bm_mpsc->stub;
+
+	return bm_mpsc;
+}
+
+int push_bm_mpsc(struct bm_mpsc *bm_mpsc, struct bm_pocket *bm_pocket) {
+	if (bm_mpsc == NULL || bm_pocket == NULL)
+		return BM_ERROR_INVAL;
+
+	/* Swing the head, then publish the link from the previous bm_pocket{} */
+
+	__atomic_store_n(&bm_pocket->next, NULL, __ATOMIC_RELAXED);
+
+	struct bm_pocket *prev = __atomic_exchange_n(&bm_mpsc->head, bm_pocket, __ATOMIC_ACQ_REL);
+
+	__atomic_store_n(&prev->next, bm_pocket, __ATOMIC_RELEASE);
+
+	return BM_ERROR_NONE;
+}
+
+static struct bm_pocket* pop_bm_mpsc_one(struct bm_mpsc *bm_mpsc) {
+	struct bm_pocket *tail = bm_mpsc->tail;
+	struct bm_pocket *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == bm_mpsc->stub) {	// Skip over the stub
+		if (next == NULL)
+			return NULL;
+
+		bm_mpsc->tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next != NULL) {
+		bm_mpsc->tail = next;
+		return tail;
+	}
+
+	/* tail is the last linked bm_pocket{}, or a producer is mid-push */
+
+	if (tail != __atomic_load_n(&bm_mpsc->head, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	push_bm_mpsc(bm_mpsc, bm_mpsc->stub);
+
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (next == NULL)
+		return NULL;
+
+	bm_mpsc->tail = next;
+
+	return tail;
+}
+
+long pop_bm_mpsc(struct bm_mpsc *bm_mpsc, struct bm_pocket **bm_pockets, long n_pkt) {
+	if (bm_mpsc == NULL || bm_pockets == NULL || n_pkt <= 0)
+		return 0;
+
+	long n_pop = 0;
+
+	for ( ; n_pop < n_pkt; n_pop++) {
+		bm_pockets[n_pop] = pop_bm_mpsc_one(bm_mpsc);
+
+		if (bm_pockets[n_pop] == NULL)
+			break;
+
+		bm_pockets[n_pop]->next = NULL;
+	}
+
+	return n_pop;
+}
+
+int (free_bm_mpsc)(struct bm_mpsc **_bm_mpsc, struct free_bm_mpsc va_list) {
+	if (_bm_mpsc == NULL || *_bm_mpsc == NULL)
+		return BM_ERROR_INVAL;
+
+	/* Hand the leftover bm_pocket{} to a bm_bag{} and free them there */
+
+	struct bm_bag *bm_bag = create_bm_bag();
+
+	if (bm_bag == NULL)
+		return BM_ERROR_FATAL;
+
+	struct bm_pocket *bm_pocket = NULL;
+
+	while (pop_bm_mpsc(*_bm_mpsc, &bm_pocket, 1) == 1)
+		attach_bm_pocket(bm_bag, bm_pocket);
+
+	int fm_status = free_bm_bag(&bm_bag, .ffunc = va_list.ffunc);
+
+	free((*_bm_mpsc)->stub);
+	free(*_bm_mpsc);
+	*_bm_mpsc = NULL;
+
+	return fm_status;
+}
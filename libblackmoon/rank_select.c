@@ -0,0 +1,274 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+/* Blocks of 2048 bits split in four 512 bit sub blocks, a select sample every 8192 set bits */
+
+#define BM_RANK_BLOCK 2048
+#define BM_RANK_SUB 512
+#define BM_RANK_SAMPLE 8192
+
+/* Word loads never read past the last byte, bits past n_bit read as zero */
+
+static inline __attribute__((always_inline)) uint64_t load_bm_rank(struct bm_rank *bm_rank, unsigned long w) {
+	unsigned long n_byte = (bm_rank->n_bit + 7) / 8;
+	uint64_t word = 0;
+
+	if (w * 8 + 8 <= n_byte)
+		memcpy(&word, bm_rank->bits + w * 8, 8);
+	else if (w * 8 < n_byte)
+		memcpy(&word, bm_rank->bits + w * 8, n_byte - w * 8);
+	else
+		return 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	if ((w + 1) * 64 > bm_rank->n_bit)
+		word = word & (~0ULL << ((w + 1) * 64 - bm_rank->n_bit));
+
+	return word;
+}
+
+static inline __attribute__((always_inline)) uint64_t block_rank(struct bm_rank *bm_rank, unsigned long b) {
+	return bm_rank->l0[(b * BM_RANK_BLOCK) >> 32] + (bm_rank->l12[b] >> 32);
+}
+
+static inline __attribute__((always_inline)) unsigned int sub_count(uint64_t entry, unsigned int sub) {
+	return (entry >> (20 - 10 * sub)) & 0x3FF;
+}
+
+/* Cores, instantiated with and without the popcnt instruction */
+
+static inline __attribute__((always_inline)) void build_core(struct bm_rank *bm_rank) {
+	unsigned long n_block = bm_rank->n_bit / BM_RANK_BLOCK + 1, total = 0;
+
+	for (unsigned long b = 0; b < n_block; b++) {
+		if (((b * BM_RANK_BLOCK) & 0xFFFFFFFFUL) == 0)
+			bm_rank->l0[(b * BM_RANK_BLOCK) >> 32] = total;
+
+		uint64_t entry = (uint64_t) (total - bm_rank->l0[(b * BM_RANK_BLOCK) >> 32]) << 32;
+
+		for (unsigned int sub = 0; sub < BM_RANK_BLOCK / BM_RANK_SUB; sub++) {
+			unsigned int count = 0;
+
+			for (unsigned long w = b * 32 + sub * 8; w < b * 32 + sub * 8 + 8; w++)
+				count = count + __builtin_popcountll(load_bm_rank(bm_rank, w));
+
+			if (sub < 3)
+				entry = entry | ((uint64_t) count << (20 - 10 * sub));
+
+			total = total + count;
+		}
+
+		bm_rank->l12[b] = entry;
+	}
+
+	bm_rank->n_one = total;
+}
+
+static inline __attribute__((always_inline)) unsigned long rank_core(struct bm_rank *bm_rank, unsigned long pos) {
+	unsigned long b = pos / BM_RANK_BLOCK, sub = (pos % BM_RANK_BLOCK) / BM_RANK_SUB;
+	uint64_t entry = bm_rank->l12[b];
+	unsigned long rank = block_rank(bm_rank, b);
+
+	for (unsigned int i = 0; i < sub; i++)
+		rank = rank + sub_count(entry, i);
+
+	for (unsigned long w = pos / BM_RANK_SUB * 8; w < pos / 64; w++)
+		rank = rank + __builtin_popcountll(load_bm_rank(bm_rank, w));
+
+	if (pos % 64 != 0)
+		rank = rank + __builtin_popcountll(load_bm_rank(bm_rank, pos / 64) >> (64 - pos % 64));
+
+	return rank;
+}
+
+static inline __attribute__((always_inline)) unsigned int select_word(uint64_t word, unsigned int k) {
+	/* Position, from the MSB, of the k-th set bit of word */
+
+#ifdef __BMI2__
+	unsigned int n = __builtin_popcountll(word);
+	return 63 - __builtin_ctzll(_pdep_u64(1ULL << (n - 1 - k), word));
+#else
+	unsigned int shift = 56, count;
+
+	for ( ; (count = __builtin_popcountll((word >> shift) & 0xFF)) <= k; shift = shift - 8)
+		k = k - count;
+
+	for (unsigned int i = 0; ; i++) {
+		if ((word >> (shift + 7 - i)) & 1) {
+			if (k == 0)
+				return 56 - shift + i;
+
+			k = k - 1;
+		}
+	}
+#endif
+}
+
+static inline __attribute__((always_inline)) long select_core(struct bm_rank *bm_rank, unsigned long k) {
+	/* Binary search the blocks between the two surrounding samples */
+
+	unsigned long lo = bm_rank->sample[k / BM_RANK_SAMPLE];
+	unsigned long hi = k / BM_RANK_SAMPLE + 1 < (unsigned long) bm_rank->n_sample ? \
+			(unsigned long) bm_rank->sample[k / BM_RANK_SAMPLE + 1] : bm_rank->n_bit / BM_RANK_BLOCK;
+
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo + 1) / 2;
+
+		if (block_rank(bm_rank, mid) <= k)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	k = k - block_rank(bm_rank, lo);
+
+	uint64_t entry = bm_rank->l12[lo];
+	unsigned int sub = 0;
+
+	for ( ; sub < 3 && k >= sub_count(entry, sub); sub++)
+		k = k - sub_count(entry, sub);
+
+	for (unsigned long w = lo * 32 + sub * 8; ; w++) {
+		uint64_t word = load_bm_rank(bm_rank, w);
+		unsigned int count = __builtin_popcountll(word);
+
+		if (k < count)
+			return w * 64 + select_word(word, k);
+
+		k = k - count;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BM_RANK_POPCNT
+
+__attribute__((target("popcnt")))
+static void build_popcnt(struct bm_rank *bm_rank) {
+	build_core(bm_rank);
+}
+
+__attribute__((target("popcnt")))
+static unsigned long rank_popcnt(struct bm_rank *bm_rank, unsigned long pos) {
+	return rank_core(bm_rank, pos);
+}
+
+__attribute__((target("popcnt")))
+static long select_popcnt(struct bm_rank *bm_rank, unsigned long k) {
+	return select_core(bm_rank, k);
+}
+#endif
+
+struct bm_rank* create_bm_rank(void* bit_array, unsigned long n_bit) {
+	if (bit_array == NULL && n_bit > 0)
+		return NULL;
+
+	struct bm_rank *bm_rank = calloc(1, sizeof(struct bm_rank));
+
+	if (bm_rank == NULL)
+		return NULL;
+
+	bm_rank->bits = bit_array;
+	bm_rank->n_bit = n_bit;
+	bm_rank->l0 = calloc((n_bit >> 32) + 1, sizeof(uint64_t));
+	bm_rank->l12 = calloc(n_bit / BM_RANK_BLOCK + 1, sizeof(uint64_t));
+
+	if (bm_rank->l0 == NULL || bm_rank->l12 == NULL)
+		goto free_bm_rank;
+
+#ifdef BM_RANK_POPCNT
+	if (__builtin_cpu_supports("popcnt"))
+		build_popcnt(bm_rank);
+	else
+#endif
+		build_core(bm_rank);
+
+	/* Record the block of every BM_RANK_SAMPLE-th set bit */
+
+	bm_rank->n_sample = (bm_rank->n_one + BM_RANK_SAMPLE - 1) / BM_RANK_SAMPLE;
+	bm_rank->sample = malloc((bm_rank->n_sample + 1) * sizeof(long));
+
+	if (bm_rank->sample == NULL)
+		goto free_bm_rank;
+
+	unsigned long b = 0, n_block = n_bit / BM_RANK_BLOCK + 1;
+
+	for (long j = 0; j < bm_rank->n_sample; j++) {
+		while (b + 1 < n_block && block_rank(bm_rank, b + 1) <= (unsigned long) j * BM_RANK_SAMPLE)
+			b++;
+
+		bm_rank->sample[j] = b;
+	}
+
+	return bm_rank;
+
+free_bm_rank:
+	free(bm_rank->l0);
+	free(bm_rank->l12);
+	free(bm_rank);
+
+	return NULL;
+}
+
+unsigned long rank_bm_rank(struct bm_rank *bm_rank, unsigned long pos) {
+	if (bm_rank == NULL)
+		return 0;
+
+	pos = pos < bm_rank->n_bit ? pos : bm_rank->n_bit;
+
+#ifdef BM_RANK_POPCNT
+	if (__builtin_cpu_supports("popcnt"))
+		return rank_popcnt(bm_rank, pos);
+#endif
+
+	return rank_core(bm_rank, pos);
+}
+
+long select_bm_rank(struct bm_rank *bm_rank, unsigned long k) {
+	if (bm_rank == NULL || k >= bm_rank->n_one)
+		return -1;
+
+#ifdef BM_RANK_POPCNT
+	if (__builtin_cpu_supports("popcnt"))
+		return select_popcnt(bm_rank, k);
+#endif
+
+	return select_core(bm_rank, k);
+}
+
+int free_bm_rank(struct bm_rank **_bm_rank) {
+	if (_bm_rank == NULL || *_bm_rank == NULL)
+		return BM_ERROR_INVAL;
+
+	free((*_bm_rank)->l0);
+	free((*_bm_rank)->l12);
+	free((*_bm_rank)->sample);
+	free(*_bm_rank);
+	*_bm_rank = NULL;
+
+	return BM_ERROR_NONE;
+}
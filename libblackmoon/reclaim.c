@@ -0,0 +1,142 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+#include <errno.h>
+
+struct bm_reclaim_job {
+	struct bm_bag *bm_bag;
+	freeing_func *ffunc;
+	batch_freeing_func *bfunc;
+};
+
+static void drain_reclaimer(struct bm_reclaimer *bm_reclaimer) {
+	struct bm_pocket *bm_pockets[64];
+	long n_pop = 0;
+
+	while ((n_pop = pop_bm_mpsc(bm_reclaimer->queue, bm_pockets, 64)) > 0) {
+		for (long at = 0; at < n_pop; at++) {
+			struct bm_reclaim_job *job = bm_pockets[at]->data;
+
+			free_bm_bag(&job->bm_bag, .ffunc = job->ffunc, .bfunc = job->bfunc);
+			free(bm_pockets[at]);
+		}
+	}
+}
+
+static void* reclaimer_loop(void *arg) {
+	struct bm_reclaimer *bm_reclaimer = arg;
+
+	for ( ; ; ) {
+		while (sem_wait(&bm_reclaimer->sem) < 0 && errno == EINTR)
+			;
+
+		/* Release whatever has been handed over so far */
+
+		drain_reclaimer(bm_reclaimer);
+
+		if (__atomic_load_n(&bm_reclaimer->stop, __ATOMIC_ACQUIRE)) {
+			drain_reclaimer(bm_reclaimer);	// Bags pushed between the drain and seeing stop
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+struct bm_reclaimer* create_bm_reclaimer() {
+	struct bm_reclaimer *bm_reclaimer = calloc(1, sizeof(struct bm_reclaimer));
+
+	if (bm_reclaimer == NULL)
+		return NULL;
+
+	bm_reclaimer->queue = create_bm_mpsc();
+
+	if (bm_reclaimer->queue == NULL)
+		goto create_error;
+
+	if (sem_init(&bm_reclaimer->sem, 0, 0) < 0)
+		goto create_error;
+
+	if (pthread_create(&bm_reclaimer->tid, NULL, reclaimer_loop, bm_reclaimer) != 0) {
+		sem_destroy(&bm_reclaimer->sem);
+		goto create_error;
+	}
+
+	return bm_reclaimer;
+
+create_error:
+
+	if (bm_reclaimer->queue != NULL)
+		free_bm_mpsc(&bm_reclaimer->queue);
+
+	free(bm_reclaimer);
+
+	return NULL;
+}
+
+int (reclaim_bm_bag)(struct bm_reclaimer *bm_reclaimer, struct bm_bag **_bm_bag, \
+		struct reclaim_bm_bag va_list) {
+	if (bm_reclaimer == NULL || _bm_bag == NULL || *_bm_bag == NULL)
+		return BM_ERROR_INVAL;
+
+	/* Wrap the bm_bag{} in an inline bm_pocket{} for the queue */
+
+	struct bm_pocket *bm_pocket = malloc(sizeof(struct bm_pocket) + sizeof(struct bm_reclaim_job));
+
+	if (bm_pocket == NULL)	// Pay for it here rather than leak it
+		return free_bm_bag(_bm_bag, .ffunc = va_list.ffunc, .bfunc = va_list.bfunc);
+
+	struct bm_reclaim_job *job = (struct bm_reclaim_job*) bm_pocket->inl;
+
+	job->bm_bag = *_bm_bag;
+	job->ffunc = va_list.ffunc;
+	job->bfunc = va_list.bfunc;
+
+	bm_pocket->data = job;
+	bm_pocket->size = sizeof(struct bm_reclaim_job);
+
+	push_bm_mpsc(bm_reclaimer->queue, bm_pocket);
+	sem_post(&bm_reclaimer->sem);
+
+	*_bm_bag = NULL;
+
+	return BM_ERROR_NONE;
+}
+
+int free_bm_reclaimer(struct bm_reclaimer **_bm_reclaimer) {
+	if (_bm_reclaimer == NULL || *_bm_reclaimer == NULL)
+		return BM_ERROR_INVAL;
+
+	struct bm_reclaimer *bm_reclaimer = *_bm_reclaimer;
+
+	/* Let the thread drain the queue and exit */
+
+	__atomic_store_n(&bm_reclaimer->stop, 1, __ATOMIC_RELEASE);
+	sem_post(&bm_reclaimer->sem);
+
+	pthread_join(bm_reclaimer->tid, NULL);
+
+	sem_destroy(&bm_reclaimer->sem);
+	free_bm_mpsc(&bm_reclaimer->queue);
+	free(bm_reclaimer);
+	*_bm_reclaimer = NULL;
+
+	return BM_ERROR_NONE;
+}
@@ -0,0 +1,955 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#define BM_ROARING_ARRAY 0
+#define BM_ROARING_BITMAP 1
+#define BM_ROARING_RUN 2
+
+#define BM_ROARING_ARRAY_MAX 4096
+#define BM_ROARING_WORDS 1024
+
+struct bm_roaring_chunk {	// Values sharing the high 16 bits
+	uint16_t key;
+	uint8_t type;
+	int32_t card;
+	int32_t n;	// Array values or runs
+	int32_t cap;
+	void *data;	// uint16_t[n], uint64_t[BM_ROARING_WORDS] or uint16_t[2 * n] as (start, length - 1)
+};
+
+/* Word helpers, value v of a chunk is bit v % 64 of word v / 64 */
+
+static void set_word_range(uint64_t *words, uint32_t start, uint32_t end) {	// [start, end]
+	uint32_t ws = start / 64, we = end / 64;
+	uint64_t ms = ~0ULL << (start % 64), me = ~0ULL >> (63 - end % 64);
+
+	if (ws == we) {
+		words[ws] |= ms & me;
+		return;
+	}
+
+	words[ws] |= ms;
+
+	for (uint32_t w = ws + 1; w < we; w++)
+		words[w] = ~0ULL;
+
+	words[we] |= me;
+}
+
+static int32_t count_words(const uint64_t *words) {
+	int32_t card = 0;
+
+	for (int w = 0; w < BM_ROARING_WORDS; w++)
+		card = card + __builtin_popcountll(words[w]);
+
+	return card;
+}
+
+static void fill_words(const struct bm_roaring_chunk *chunk, uint64_t *words) {
+	const uint16_t *v = chunk->data;
+
+	if (chunk->type == BM_ROARING_BITMAP) {
+		memcpy(words, chunk->data, BM_ROARING_WORDS * sizeof(uint64_t));
+		return;
+	}
+
+	memset(words, 0, BM_ROARING_WORDS * sizeof(uint64_t));
+
+	if (chunk->type == BM_ROARING_ARRAY) {
+		for (int32_t i = 0; i < chunk->n; i++)
+			words[v[i] / 64] |= 1ULL << (v[i] % 64);
+	}
+	else {
+		for (int32_t i = 0; i < chunk->n; i++)
+			set_word_range(words, v[2 * i], (uint32_t) v[2 * i] + v[2 * i + 1]);
+	}
+}
+
+/* Container conversions, chunk->data is replaced */
+
+static int chunk_to_bitmap(struct bm_roaring_chunk *chunk) {
+	uint64_t *words = malloc(BM_ROARING_WORDS * sizeof(uint64_t));
+
+	if (words == NULL)
+		return BM_ERROR_FATAL;
+
+	fill_words(chunk, words);
+
+	free(chunk->data);
+	chunk->data = words;
+	chunk->type = BM_ROARING_BITMAP;
+	chunk->n = chunk->cap = 0;
+
+	return BM_ERROR_NONE;
+}
+
+static int chunk_to_array(struct bm_roaring_chunk *chunk) {	// Needs chunk->card <= BM_ROARING_ARRAY_MAX
+	int32_t cap = chunk->card > 0 ? chunk->card : 1, n = 0;
+	uint16_t *values = malloc(cap * sizeof(uint16_t));
+
+	if (values == NULL)
+		return BM_ERROR_FATAL;
+
+	if (chunk->type == BM_ROARING_BITMAP) {
+		uint64_t *words = chunk->data;
+
+		for (int w = 0; w < BM_ROARING_WORDS; w++) {
+			for (uint64_t word = words[w]; word != 0; word = word & (word - 1))
+				values[n++] = w * 64 + __builtin_ctzll(word);
+		}
+	}
+	else if (chunk->type == BM_ROARING_RUN) {
+		uint16_t *runs = chunk->data;
+
+		for (int32_t i = 0; i < chunk->n; i++) {
+			for (uint32_t v = runs[2 * i]; v <= (uint32_t) runs[2 * i] + runs[2 * i + 1]; v++)
+				values[n++] = v;
+		}
+	}
+	else {
+		memcpy(values, chunk->data, chunk->n * sizeof(uint16_t));
+		n = chunk->n;
+	}
+
+	free(chunk->data);
+	chunk->data = values;
+	chunk->type = BM_ROARING_ARRAY;
+	chunk->n = n;
+	chunk->cap = cap;
+
+	return BM_ERROR_NONE;
+}
+
+static int32_t count_runs(const struct bm_roaring_chunk *chunk) {
+	int32_t n_run = 0;
+
+	if (chunk->type == BM_ROARING_ARRAY) {
+		const uint16_t *v = chunk->data;
+
+		for (int32_t i = 0; i < chunk->n; i++)
+			n_run = n_run + (i == 0 || v[i] != v[i - 1] + 1);
+	}
+	else if (chunk->type == BM_ROARING_BITMAP) {
+		const uint64_t *words = chunk->data;
+		uint64_t carry = 0;
+
+		for (int w = 0; w < BM_ROARING_WORDS; w++) {
+			n_run = n_run + __builtin_popcountll(words[w] & ~((words[w] << 1) | carry));
+			carry = words[w] >> 63;
+		}
+	}
+	else
+		n_run = chunk->n;
+
+	return n_run;
+}
+
+static int chunk_to_run(struct bm_roaring_chunk *chunk, int32_t n_run) {
+	uint16_t *runs = malloc(2 * (n_run > 0 ? n_run : 1) * sizeof(uint16_t));
+
+	if (runs == NULL)
+		return BM_ERROR_FATAL;
+
+	int32_t n = 0;
+	long start = -1, last = -2;
+
+	if (chunk->type == BM_ROARING_BITMAP) {
+		const uint64_t *words = chunk->data;
+
+		for (int w = 0; w < BM_ROARING_WORDS; w++) {
+			uint64_t word = words[w];
+
+			if ((start < 0 && word == 0) || (start >= 0 && word == ~0ULL))
+				continue;
+
+			for (int b = 0; b < 64; b++) {
+				int in = (word >> b) & 1;
+
+				if (in && start < 0)
+					start = w * 64 + b;
+				else if (!in && start >= 0) {
+					runs[2 * n] = start;
+					runs[2 * n + 1] = w * 64 + b - 1 - start;
+					n++;
+					start = -1;
+				}
+			}
+		}
+
+		last = 65535;
+	}
+	else {
+		const uint16_t *values = chunk->data;
+
+		for (int32_t i = 0; i < chunk->n; i++) {
+			if (values[i] != last + 1) {
+				if (start >= 0) {
+					runs[2 * n] = start;
+					runs[2 * n + 1] = last - start;
+					n++;
+				}
+
+				start = values[i];
+			}
+
+			last = values[i];
+		}
+	}
+
+	if (start >= 0) {
+		runs[2 * n] = start;
+		runs[2 * n + 1] = last - start;
+		n++;
+	}
+
+	free(chunk->data);
+	chunk->data = runs;
+	chunk->type = BM_ROARING_RUN;
+	chunk->n = chunk->cap = n;
+
+	return BM_ERROR_NONE;
+}
+
+/* Single value access within a chunk */
+
+static int32_t search_values(const uint16_t *values, int32_t n, uint16_t low) {	// First index >= low
+	int32_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		int32_t mid = (lo + hi) / 2;
+
+		if (values[mid] < low)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int32_t search_runs(const uint16_t *runs, int32_t n, uint16_t low) {	// First run ending >= low
+	int32_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		int32_t mid = (lo + hi) / 2;
+
+		if ((uint32_t) runs[2 * mid] + runs[2 * mid + 1] < low)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int chunk_contains(const struct bm_roaring_chunk *chunk, uint16_t low) {
+	if (chunk->type == BM_ROARING_BITMAP)
+		return (((uint64_t*) chunk->data)[low / 64] >> (low % 64)) & 1;
+
+	if (chunk->type == BM_ROARING_ARRAY) {
+		int32_t at = search_values(chunk->data, chunk->n, low);
+		return at < chunk->n && ((uint16_t*) chunk->data)[at] == low;
+	}
+
+	int32_t at = search_runs(chunk->data, chunk->n, low);
+	return at < chunk->n && ((uint16_t*) chunk->data)[2 * at] <= low;
+}
+
+static long chunk_next(const struct bm_roaring_chunk *chunk, uint32_t low) {	// Smallest value >= low, or -1
+	if (low > 65535)
+		return -1;
+
+	if (chunk->type == BM_ROARING_ARRAY) {
+		int32_t at = search_values(chunk->data, chunk->n, low);
+		return at < chunk->n ? ((uint16_t*) chunk->data)[at] : -1;
+	}
+
+	if (chunk->type == BM_ROARING_RUN) {
+		const uint16_t *runs = chunk->data;
+		int32_t at = search_runs(runs, chunk->n, low);
+
+		if (at >= chunk->n)
+			return -1;
+
+		return runs[2 * at] > low ? runs[2 * at] : (long) low;
+	}
+
+	const uint64_t *words = chunk->data;
+	uint32_t w = low / 64;
+	uint64_t word = words[w] & (~0ULL << (low % 64));
+
+	while (word == 0) {
+		if (++w == BM_ROARING_WORDS)
+			return -1;
+
+		word = words[w];
+	}
+
+	return w * 64 + __builtin_ctzll(word);
+}
+
+static int chunk_add(struct bm_roaring_chunk *chunk, uint16_t low) {
+	if (chunk_contains(chunk, low))
+		return BM_ERROR_NONE;
+
+	/* Runs are rebuilt as array or bitmap, optimize_bm_roaring() brings them back */
+
+	if (chunk->type == BM_ROARING_RUN && \
+			(chunk->card < BM_ROARING_ARRAY_MAX ? chunk_to_array(chunk) : chunk_to_bitmap(chunk)) != BM_ERROR_NONE)
+		return BM_ERROR_FATAL;
+
+	if (chunk->type == BM_ROARING_ARRAY && chunk->n == BM_ROARING_ARRAY_MAX && chunk_to_bitmap(chunk) != BM_ERROR_NONE)
+		return BM_ERROR_FATAL;
+
+	if (chunk->type == BM_ROARING_BITMAP) {
+		((uint64_t*) chunk->data)[low / 64] |= 1ULL << (low % 64);
+		chunk->card = chunk->card + 1;
+
+		return BM_ERROR_NONE;
+	}
+
+	if (chunk->n == chunk->cap) {
+		int32_t cap = chunk->cap == 0 ? 4 : chunk->cap * 2 < BM_ROARING_ARRAY_MAX ? chunk->cap * 2 : BM_ROARING_ARRAY_MAX;
+		uint16_t *values = realloc(chunk->data, cap * sizeof(uint16_t));
+
+		if (values == NULL)
+			return BM_ERROR_FATAL;
+
+		chunk->data = values;
+		chunk->cap = cap;
+	}
+
+	uint16_t *values = chunk->data;
+	int32_t at = search_values(values, chunk->n, low);
+
+	memmove(values + at + 1, values + at, (chunk->n - at) * sizeof(uint16_t));
+	values[at] = low;
+	chunk->n = chunk->n + 1;
+	chunk->card = chunk->card + 1;
+
+	return BM_ERROR_NONE;
+}
+
+static int chunk_remove(struct bm_roaring_chunk *chunk, uint16_t low) {
+	if (!chunk_contains(chunk, low))
+		return BM_ERROR_NONE;
+
+	if (chunk->type == BM_ROARING_RUN && \
+			(chunk->card <= BM_ROARING_ARRAY_MAX ? chunk_to_array(chunk) : chunk_to_bitmap(chunk)) != BM_ERROR_NONE)
+		return BM_ERROR_FATAL;
+
+	chunk->card = chunk->card - 1;
+
+	if (chunk->type == BM_ROARING_BITMAP) {
+		((uint64_t*) chunk->data)[low / 64] &= ~(1ULL << (low % 64));
+
+		return chunk->card <= BM_ROARING_ARRAY_MAX ? chunk_to_array(chunk) : BM_ERROR_NONE;
+	}
+
+	uint16_t *values = chunk->data;
+	int32_t at = search_values(values, chunk->n, low);
+
+	memmove(values + at, values + at + 1, (chunk->n - at - 1) * sizeof(uint16_t));
+	chunk->n = chunk->n - 1;
+
+	return BM_ERROR_NONE;
+}
+
+/* Chunk directory, sorted by key */
+
+static long find_chunk(struct bm_roaring *bm_roaring, uint16_t key) {	// First index with key >= key
+	long lo = 0, hi = bm_roaring->n_chunk;
+
+	while (lo < hi) {
+		long mid = (lo + hi) / 2;
+
+		if (bm_roaring->chunk[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static struct bm_roaring_chunk* insert_chunk(struct bm_roaring *bm_roaring, long at, uint16_t key) {
+	if (bm_roaring->n_chunk == bm_roaring->cap) {
+		long cap = bm_roaring->cap > 0 ? bm_roaring->cap * 2 : 4;
+		struct bm_roaring_chunk *chunk = realloc(bm_roaring->chunk, cap * sizeof(struct bm_roaring_chunk));
+
+		if (chunk == NULL)
+			return NULL;
+
+		bm_roaring->chunk = chunk;
+		bm_roaring->cap = cap;
+	}
+
+	memmove(bm_roaring->chunk + at + 1, bm_roaring->chunk + at, \
+			(bm_roaring->n_chunk - at) * sizeof(struct bm_roaring_chunk));
+	bm_roaring->n_chunk = bm_roaring->n_chunk + 1;
+
+	struct bm_roaring_chunk *chunk = bm_roaring->chunk + at;
+	memset(chunk, 0, sizeof(struct bm_roaring_chunk));
+	chunk->key = key;
+	chunk->type = BM_ROARING_ARRAY;
+
+	return chunk;
+}
+
+static void delete_chunk(struct bm_roaring *bm_roaring, long at) {
+	free(bm_roaring->chunk[at].data);
+
+	memmove(bm_roaring->chunk + at, bm_roaring->chunk + at + 1, \
+			(bm_roaring->n_chunk - at - 1) * sizeof(struct bm_roaring_chunk));
+	bm_roaring->n_chunk = bm_roaring->n_chunk - 1;
+}
+
+static struct bm_roaring_chunk* append_chunk(struct bm_roaring *bm_roaring, struct bm_roaring_chunk *chunk) {
+	struct bm_roaring_chunk *tail = insert_chunk(bm_roaring, bm_roaring->n_chunk, chunk->key);
+
+	if (tail == NULL)
+		return NULL;
+
+	*tail = *chunk;
+
+	return tail;
+}
+
+struct bm_roaring* create_bm_roaring() {
+	return calloc(1, sizeof(struct bm_roaring));
+}
+
+int set_bm_roaring(struct bm_roaring *bm_roaring, uint32_t value) {
+	if (bm_roaring == NULL)
+		return BM_ERROR_INVAL;
+
+	long at = find_chunk(bm_roaring, value >> 16);
+	struct bm_roaring_chunk *chunk = bm_roaring->chunk + at;
+
+	if (at == bm_roaring->n_chunk || chunk->key != value >> 16) {
+		if ((chunk = insert_chunk(bm_roaring, at, value >> 16)) == NULL)
+			return BM_ERROR_FATAL;
+	}
+
+	if (chunk_add(chunk, value & 0xFFFF) != BM_ERROR_NONE) {
+		if (chunk->card == 0)
+			delete_chunk(bm_roaring, at);
+
+		return BM_ERROR_FATAL;
+	}
+
+	return BM_ERROR_NONE;
+}
+
+int clear_bm_roaring(struct bm_roaring *bm_roaring, uint32_t value) {
+	if (bm_roaring == NULL)
+		return BM_ERROR_INVAL;
+
+	long at = find_chunk(bm_roaring, value >> 16);
+
+	if (at == bm_roaring->n_chunk || bm_roaring->chunk[at].key != value >> 16)
+		return BM_ERROR_NONE;
+
+	if (chunk_remove(bm_roaring->chunk + at, value & 0xFFFF) != BM_ERROR_NONE)
+		return BM_ERROR_FATAL;
+
+	if (bm_roaring->chunk[at].card == 0)
+		delete_chunk(bm_roaring, at);
+
+	return BM_ERROR_NONE;
+}
+
+bit get_bm_roaring(struct bm_roaring *bm_roaring, uint32_t value) {
+	if (bm_roaring == NULL)
+		return 0;
+
+	long at = find_chunk(bm_roaring, value >> 16);
+
+	if (at == bm_roaring->n_chunk || bm_roaring->chunk[at].key != value >> 16)
+		return 0;
+
+	return chunk_contains(bm_roaring->chunk + at, value & 0xFFFF);
+}
+
+uint64_t count_bm_roaring(struct bm_roaring *bm_roaring) {
+	uint64_t card = 0;
+
+	for (long at = 0; bm_roaring != NULL && at < bm_roaring->n_chunk; at++)
+		card = card + bm_roaring->chunk[at].card;
+
+	return card;
+}
+
+int next_bm_roaring(struct bm_roaring *bm_roaring, long *iter, uint32_t *value) {
+	if (bm_roaring == NULL || iter == NULL || *iter < 0 || *iter > UINT32_MAX)
+		return BM_ERROR_INVAL;
+
+	/* *iter is the smallest value still to be reported */
+
+	for (long at = find_chunk(bm_roaring, *iter >> 16); at < bm_roaring->n_chunk; at++) {
+		struct bm_roaring_chunk *chunk = bm_roaring->chunk + at;
+		long low = chunk_next(chunk, chunk->key == *iter >> 16 ? *iter & 0xFFFF : 0);
+
+		if (low < 0)
+			continue;
+
+		value != NULL ? *value = ((uint32_t) chunk->key << 16) | low : 0;
+		*iter = (((long) chunk->key << 16) | low) + 1;
+
+		return BM_ERROR_NONE;
+	}
+
+	*iter = (long) UINT32_MAX + 1;
+
+	return BM_ERROR_INVAL;
+}
+
+uint32_t roaring_to_int(struct bm_roaring *bm_roaring, uint32_t bit_start, unsigned int _bit_count) {
+	unsigned int bit_count = _bit_count < sizeof(uint32_t) * 8 ? \
+				 _bit_count : sizeof(uint32_t) * 8;
+
+	/* Same MSB first layout as bitarray_to_int(), visiting only the members in range */
+
+	long iter = bit_start, end = (long) bit_start + bit_count;
+	uint32_t value = 0, member = 0;
+
+	while (next_bm_roaring(bm_roaring, &iter, &member) == BM_ERROR_NONE && member < end)
+		value = value | (1U << (end - 1 - member));
+
+	return value;
+}
+
+int optimize_bm_roaring(struct bm_roaring *bm_roaring) {
+	if (bm_roaring == NULL)
+		return BM_ERROR_INVAL;
+
+	/* Pick the smallest of the three encodings for every chunk */
+
+	for (long at = 0; at < bm_roaring->n_chunk; at++) {
+		struct bm_roaring_chunk *chunk = bm_roaring->chunk + at;
+		long n_run = count_runs(chunk);
+		long run_size = 4 * n_run, array_size = 2 * (long) chunk->card;
+		long bitmap_size = BM_ROARING_WORDS * sizeof(uint64_t);
+		int ret = BM_ERROR_NONE;
+
+		if (run_size < array_size && run_size < bitmap_size) {
+			if (chunk->type != BM_ROARING_RUN)
+				ret = chunk_to_run(chunk, n_run);
+		}
+		else if (chunk->card <= BM_ROARING_ARRAY_MAX) {
+			if (chunk->type != BM_ROARING_ARRAY || chunk->cap > chunk->n)
+				ret = chunk_to_array(chunk);
+		}
+		else if (chunk->type != BM_ROARING_BITMAP)
+			ret = chunk_to_bitmap(chunk);
+
+		if (ret != BM_ERROR_NONE)
+			return ret;
+	}
+
+	return BM_ERROR_NONE;
+}
+
+/* Set operations, each producing a fresh chunk */
+
+static int copy_chunk(const struct bm_roaring_chunk *chunk, struct bm_roaring_chunk *copy) {
+	long size = chunk->type == BM_ROARING_BITMAP ? BM_ROARING_WORDS * sizeof(uint64_t) : \
+			chunk->type == BM_ROARING_ARRAY ? chunk->n * sizeof(uint16_t) : 2 * chunk->n * sizeof(uint16_t);
+
+	*copy = *chunk;
+	copy->cap = chunk->type == BM_ROARING_BITMAP ? 0 : chunk->n;
+
+	if ((copy->data = malloc(size > 0 ? size : 1)) == NULL)
+		return BM_ERROR_FATAL;
+
+	memcpy(copy->data, chunk->data, size);
+
+	return BM_ERROR_NONE;
+}
+
+static int or_chunk(const struct bm_roaring_chunk *a, const struct bm_roaring_chunk *b, struct bm_roaring_chunk *out) {
+	memset(out, 0, sizeof(struct bm_roaring_chunk));
+	out->key = a->key;
+
+	if (a->type == BM_ROARING_ARRAY && b->type == BM_ROARING_ARRAY && a->n + b->n <= BM_ROARING_ARRAY_MAX) {
+		const uint16_t *va = a->data, *vb = b->data;
+		uint16_t *v = malloc((a->n + b->n > 0 ? a->n + b->n : 1) * sizeof(uint16_t));
+
+		if (v == NULL)
+			return BM_ERROR_FATAL;
+
+		int32_t i = 0, j = 0, n = 0;
+
+		while (i < a->n && j < b->n) {
+			if (va[i] < vb[j])
+				v[n++] = va[i++];
+			else if (va[i] > vb[j])
+				v[n++] = vb[j++];
+			else {
+				v[n++] = va[i++];
+				j++;
+			}
+		}
+
+		for ( ; i < a->n; i++)
+			v[n++] = va[i];
+
+		for ( ; j < b->n; j++)
+			v[n++] = vb[j];
+
+		out->type = BM_ROARING_ARRAY;
+		out->data = v;
+		out->n = out->card = n;
+		out->cap = a->n + b->n > 0 ? a->n + b->n : 1;
+
+		return BM_ERROR_NONE;
+	}
+
+	/* Everything else goes through a bitmap */
+
+	uint64_t *words = malloc(BM_ROARING_WORDS * sizeof(uint64_t)), *other = NULL;
+
+	if (words == NULL)
+		return BM_ERROR_FATAL;
+
+	fill_words(a, words);
+
+	if (b->type == BM_ROARING_BITMAP)
+		other = b->data;
+	else if (b->type == BM_ROARING_ARRAY) {
+		for (int32_t i = 0; i < b->n; i++)
+			words[((uint16_t*) b->data)[i] / 64] |= 1ULL << (((uint16_t*) b->data)[i] % 64);
+	}
+	else {
+		for (int32_t i = 0; i < b->n; i++)
+			set_word_range(words, ((uint16_t*) b->data)[2 * i], \
+					(uint32_t) ((uint16_t*) b->data)[2 * i] + ((uint16_t*) b->data)[2 * i + 1]);
+	}
+
+	for (int w = 0; other != NULL && w < BM_ROARING_WORDS; w++)
+		words[w] = words[w] | other[w];
+
+	out->type = BM_ROARING_BITMAP;
+	out->data = words;
+	out->card = count_words(words);
+
+	return out->card <= BM_ROARING_ARRAY_MAX ? chunk_to_array(out) : BM_ERROR_NONE;
+}
+
+static int and_chunk(const struct bm_roaring_chunk *a, const struct bm_roaring_chunk *b, struct bm_roaring_chunk *out) {
+	memset(out, 0, sizeof(struct bm_roaring_chunk));
+	out->key = a->key;
+
+	if (b->type == BM_ROARING_ARRAY && a->type != BM_ROARING_ARRAY) {
+		const struct bm_roaring_chunk *t = a;
+		a = b;
+		b = t;
+	}
+
+	/* Arrays are filtered, by merging against another array or probing otherwise */
+
+	if (a->type == BM_ROARING_ARRAY) {
+		const uint16_t *va = a->data, *vb = b->data;
+		uint16_t *v = malloc((a->n > 0 ? a->n : 1) * sizeof(uint16_t));
+
+		if (v == NULL)
+			return BM_ERROR_FATAL;
+
+		int32_t n = 0;
+
+		if (b->type == BM_ROARING_ARRAY) {
+			for (int32_t i = 0, j = 0; i < a->n && j < b->n; ) {
+				if (va[i] < vb[j])
+					i++;
+				else if (va[i] > vb[j])
+					j++;
+				else {
+					v[n++] = va[i++];
+					j++;
+				}
+			}
+		}
+		else {
+			for (int32_t i = 0; i < a->n; i++) {
+				if (chunk_contains(b, va[i]))
+					v[n++] = va[i];
+			}
+		}
+
+		out->type = BM_ROARING_ARRAY;
+		out->data = v;
+		out->n = out->card = n;
+		out->cap = a->n > 0 ? a->n : 1;
+
+		return BM_ERROR_NONE;
+	}
+
+	uint64_t *words = malloc(BM_ROARING_WORDS * sizeof(uint64_t)), other[BM_ROARING_WORDS];
+
+	if (words == NULL)
+		return BM_ERROR_FATAL;
+
+	fill_words(a, words);
+	fill_words(b, other);
+
+	for (int w = 0; w < BM_ROARING_WORDS; w++)
+		words[w] = words[w] & other[w];
+
+	out->type = BM_ROARING_BITMAP;
+	out->data = words;
+	out->card = count_words(words);
+
+	return out->card <= BM_ROARING_ARRAY_MAX ? chunk_to_array(out) : BM_ERROR_NONE;
+}
+
+struct bm_roaring* or_bm_roaring(struct bm_roaring *a, struct bm_roaring *b) {
+	if (a == NULL || b == NULL)
+		return NULL;
+
+	struct bm_roaring *bm_roaring = create_bm_roaring();
+
+	if (bm_roaring == NULL)
+		return NULL;
+
+	struct bm_roaring_chunk chunk;
+	long i = 0, j = 0;
+	int ret = BM_ERROR_NONE;
+
+	while (ret == BM_ERROR_NONE && (i < a->n_chunk || j < b->n_chunk)) {
+		if (j == b->n_chunk || (i < a->n_chunk && a->chunk[i].key < b->chunk[j].key))
+			ret = copy_chunk(a->chunk + i++, &chunk);
+		else if (i == a->n_chunk || b->chunk[j].key < a->chunk[i].key)
+			ret = copy_chunk(b->chunk + j++, &chunk);
+		else
+			ret = or_chunk(a->chunk + i++, b->chunk + j++, &chunk);
+
+		if (ret == BM_ERROR_NONE && append_chunk(bm_roaring, &chunk) == NULL) {
+			free(chunk.data);
+			ret = BM_ERROR_FATAL;
+		}
+	}
+
+	if (ret != BM_ERROR_NONE)
+		free_bm_roaring(&bm_roaring);
+
+	return bm_roaring;
+}
+
+struct bm_roaring* and_bm_roaring(struct bm_roaring *a, struct bm_roaring *b) {
+	if (a == NULL || b == NULL)
+		return NULL;
+
+	struct bm_roaring *bm_roaring = create_bm_roaring();
+
+	if (bm_roaring == NULL)
+		return NULL;
+
+	struct bm_roaring_chunk chunk;
+	long i = 0, j = 0;
+	int ret = BM_ERROR_NONE;
+
+	while (ret == BM_ERROR_NONE && i < a->n_chunk && j < b->n_chunk) {
+		if (a->chunk[i].key < b->chunk[j].key) {
+			i++;
+			continue;
+		}
+		else if (b->chunk[j].key < a->chunk[i].key) {
+			j++;
+			continue;
+		}
+
+		if ((ret = and_chunk(a->chunk + i++, b->chunk + j++, &chunk)) != BM_ERROR_NONE)
+			break;
+
+		if (chunk.card == 0)
+			free(chunk.data);
+		else if (append_chunk(bm_roaring, &chunk) == NULL) {
+			free(chunk.data);
+			ret = BM_ERROR_FATAL;
+		}
+	}
+
+	if (ret != BM_ERROR_NONE)
+		free_bm_roaring(&bm_roaring);
+
+	return bm_roaring;
+}
+
+/* Serialization, little endian: u32 n_chunk, then per chunk u16 key, u8 type, u8 0, u32 n, then the payloads */
+
+static inline void put_le(uint8_t *p, uint64_t v, int n_byte) {
+	for (int i = 0; i < n_byte; i++)
+		p[i] = v >> (8 * i);
+}
+
+static inline uint64_t get_le(const uint8_t *p, int n_byte) {
+	uint64_t v = 0;
+
+	for (int i = 0; i < n_byte; i++)
+		v = v | ((uint64_t) p[i] << (8 * i));
+
+	return v;
+}
+
+static long chunk_payload(uint8_t type, long n) {
+	return type == BM_ROARING_BITMAP ? BM_ROARING_WORDS * 8 : type == BM_ROARING_ARRAY ? 2 * n : 4 * n;
+}
+
+struct bm_data* serialize_bm_roaring(struct bm_roaring *bm_roaring) {
+	if (bm_roaring == NULL)
+		return NULL;
+
+	long size = 4 + 8 * bm_roaring->n_chunk;
+
+	for (long at = 0; at < bm_roaring->n_chunk; at++)
+		size = size + chunk_payload(bm_roaring->chunk[at].type, bm_roaring->chunk[at].n);
+
+	struct bm_data *bm_data = create_bm_data(size);
+
+	if (bm_data == NULL)
+		return NULL;
+
+	uint8_t *head = bm_data->data, *body = head + 4 + 8 * bm_roaring->n_chunk;
+
+	put_le(head, bm_roaring->n_chunk, 4);
+	head = head + 4;
+
+	for (long at = 0; at < bm_roaring->n_chunk; at++, head = head + 8) {
+		struct bm_roaring_chunk *chunk = bm_roaring->chunk + at;
+
+		put_le(head, chunk->key, 2);
+		head[2] = chunk->type;
+		head[3] = 0;
+		put_le(head + 4, chunk->type == BM_ROARING_BITMAP ? chunk->card : chunk->n, 4);
+
+		if (chunk->type == BM_ROARING_BITMAP) {
+			for (int w = 0; w < BM_ROARING_WORDS; w++, body = body + 8)
+				put_le(body, ((uint64_t*) chunk->data)[w], 8);
+		}
+		else {
+			long n_half = chunk->type == BM_ROARING_ARRAY ? chunk->n : 2 * chunk->n;
+
+			for (long i = 0; i < n_half; i++, body = body + 2)
+				put_le(body, ((uint16_t*) chunk->data)[i], 2);
+		}
+	}
+
+	return bm_data;
+}
+
+struct bm_roaring* deserialize_bm_roaring(struct bm_data *bm_data) {
+	if (bm_data == NULL || bm_data->data == NULL || bm_data->size < 4)
+		return NULL;
+
+	const uint8_t *head = bm_data->data;
+	long n_chunk = get_le(head, 4), size = bm_data->size;
+
+	if (n_chunk > 65536 || size < 4 + 8 * n_chunk)
+		return NULL;
+
+	struct bm_roaring *bm_roaring = create_bm_roaring();
+
+	if (bm_roaring == NULL)
+		return NULL;
+
+	const uint8_t *body = head + 4 + 8 * n_chunk, *end = head + size;
+	head = head + 4;
+
+	/* Every chunk is validated, a malformed input yields NULL */
+
+	for (long at = 0; at < n_chunk; at++, head = head + 8) {
+		struct bm_roaring_chunk chunk = {.key = get_le(head, 2), .type = head[2]};
+		long n = get_le(head + 4, 4);
+
+		if (chunk.type > BM_ROARING_RUN || (at > 0 && chunk.key <= bm_roaring->chunk[at - 1].key) || \
+				n > 65536 || chunk_payload(chunk.type, n) > end - body)
+			goto free_bm_roaring;
+
+		long payload = chunk_payload(chunk.type, n);
+
+		if ((chunk.data = malloc(payload > 0 ? payload : 1)) == NULL)
+			goto free_bm_roaring;
+
+		int valid = 1;
+
+		if (chunk.type == BM_ROARING_BITMAP) {
+			for (int w = 0; w < BM_ROARING_WORDS; w++)
+				((uint64_t*) chunk.data)[w] = get_le(body + 8 * w, 8);
+
+			chunk.card = count_words(chunk.data);
+			valid = chunk.card == n;
+		}
+		else if (chunk.type == BM_ROARING_ARRAY) {
+			uint16_t *values = chunk.data;
+
+			for (long i = 0; i < n; i++) {
+				values[i] = get_le(body + 2 * i, 2);
+				valid = valid && (i == 0 || values[i] > values[i - 1]);
+			}
+
+			chunk.n = chunk.cap = chunk.card = n;
+			valid = valid && n <= BM_ROARING_ARRAY_MAX;
+		}
+		else {
+			uint16_t *runs = chunk.data;
+			long last = -2;
+
+			for (long i = 0; i < n; i++) {
+				runs[2 * i] = get_le(body + 4 * i, 2);
+				runs[2 * i + 1] = get_le(body + 4 * i + 2, 2);
+
+				valid = valid && runs[2 * i] > last + 1 && (long) runs[2 * i] + runs[2 * i + 1] <= 65535;
+				last = (long) runs[2 * i] + runs[2 * i + 1];
+				chunk.card = chunk.card + runs[2 * i + 1] + 1;
+			}
+
+			chunk.n = chunk.cap = n;
+		}
+
+		body = body + payload;
+
+		if (!valid || chunk.card == 0 || append_chunk(bm_roaring, &chunk) == NULL) {
+			free(chunk.data);
+			goto free_bm_roaring;
+		}
+	}
+
+	return bm_roaring;
+
+free_bm_roaring:
+	free_bm_roaring(&bm_roaring);
+
+	return NULL;
+}
+
+int free_bm_roaring(struct bm_roaring **_bm_roaring) {
+	if (_bm_roaring == NULL || *_bm_roaring == NULL)
+		return BM_ERROR_INVAL;
+
+	for (long at = 0; at < (*_bm_roaring)->n_chunk; at++)
+		free((*_bm_roaring)->chunk[at].data);
+
+	free((*_bm_roaring)->chunk);
+	free(*_bm_roaring);
+	*_bm_roaring = NULL;
+
+	return BM_ERROR_NONE;
+}
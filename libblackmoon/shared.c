@@ -0,0 +1,150 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+struct bm_shared* (share_bm_data)(struct bm_data **_bm_data, struct share_bm_data va_list) {
+	if (_bm_data == NULL || *_bm_data == NULL)
+		return NULL;
+
+	struct bm_shared *bm_shared = malloc(sizeof(struct bm_shared));
+
+	if (bm_shared == NULL)
+		return NULL;
+
+	/* Take over bm_data{}->data, release the header */
+
+	struct bm_data *bm_data = *_bm_data;
+
+	bm_shared->data = bm_data->data;
+	bm_shared->size = bm_data->data == NULL || bm_data->size <= 0 ? 0 : bm_data->size;
+	bm_shared->refs = 1;
+	bm_shared->ffunc = va_list.ffunc;
+
+	free(bm_data);
+	*_bm_data = NULL;
+
+	return bm_shared;
+}
+
+struct bm_shared* share_inline_bm_data(struct bm_idata **_bm_idata) {
+	if (_bm_idata == NULL || *_bm_idata == NULL)
+		return NULL;
+
+	struct bm_shared *bm_shared = malloc(sizeof(struct bm_shared));
+
+	if (bm_shared == NULL)
+		return NULL;
+
+	/* Inline payload keeps its header, both go through bm_free_inline() */
+
+	struct bm_idata *bm_idata = *_bm_idata;
+
+	bm_shared->data = bm_idata->data;
+	bm_shared->size = bm_idata->data == NULL || bm_idata->size <= 0 ? 0 : bm_idata->size;
+	bm_shared->refs = 1;
+	bm_shared->ffunc = bm_idata->data != NULL ? bm_free_inline : NULL;
+
+	if (bm_idata->data == NULL)
+		free(bm_idata);
+
+	*_bm_idata = NULL;
+
+	return bm_shared;
+}
+
+struct bm_shared* hold_bm_shared(struct bm_shared *bm_shared) {
+	if (bm_shared == NULL)
+		return NULL;
+
+	__atomic_fetch_add(&bm_shared->refs, 1, __ATOMIC_RELAXED);
+
+	return bm_shared;
+}
+
+int release_bm_shared(struct bm_shared **_bm_shared) {
+	if (_bm_shared == NULL || *_bm_shared == NULL)
+		return BM_ERROR_INVAL;
+
+	struct bm_shared *bm_shared = *_bm_shared;
+	*_bm_shared = NULL;
+
+	if (__atomic_sub_fetch(&bm_shared->refs, 1, __ATOMIC_ACQ_REL) > 0)
+		return BM_ERROR_NONE;
+
+	/* Last reference, free through the bm_shared{}->ffunc */
+
+	int rs_status = BM_ERROR_NONE;
+
+	if (bm_shared->ffunc != NULL && (*(bm_shared->ffunc))(bm_shared->data) != BM_ERROR_NONE)
+		rs_status = BM_ERROR_INVAL;
+
+	free(bm_shared);
+
+	return rs_status;
+}
+
+struct bm_slice* create_bm_slice(struct bm_shared *bm_shared, long offset, long size) {
+	if (bm_shared == NULL || offset < 0 || size < 0 || offset > bm_shared->size || \
+			size > bm_shared->size - offset)
+		return NULL;
+
+	struct bm_slice *bm_slice = malloc(sizeof(struct bm_slice));
+
+	if (bm_slice == NULL)
+		return NULL;
+
+	bm_slice->data = bm_shared->data + offset;
+	bm_slice->size = size;
+	bm_slice->shared = hold_bm_shared(bm_shared);
+
+	return bm_slice;
+}
+
+int free_bm_slice(struct bm_slice **_bm_slice) {
+	if (_bm_slice == NULL || *_bm_slice == NULL)
+		return BM_ERROR_INVAL;
+
+	int fs_status = release_bm_shared(&((*_bm_slice)->shared));
+
+	free(*_bm_slice);
+	*_bm_slice = NULL;
+
+	return fs_status;
+}
+
+static int bm_release_shared(void *bm_shared) {
+	return release_bm_shared((struct bm_shared**) &bm_shared);
+}
+
+int place_bm_slice(struct bm_bag *bm_bag, struct bm_slice *bm_slice) {
+	if (bm_bag == NULL || bm_slice == NULL || bm_slice->shared == NULL)
+		return BM_ERROR_INVAL;
+
+	/* The bm_pocket{} holds its own reference to the bm_shared{} */
+
+	int pb_status = borrow_bm_data(bm_bag, (struct bm_data*) bm_slice, .ffunc = bm_release_shared);
+
+	if (pb_status != BM_ERROR_NONE)
+		return pb_status;
+
+	bm_bag->end->owner = hold_bm_shared(bm_slice->shared);
+
+	return BM_ERROR_NONE;
+}
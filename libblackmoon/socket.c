@@ -19,17 +19,41 @@
 #include "blackmoon.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <sys/uio.h>
 #include <sys/signalfd.h>
 #include <unistd.h>
 
-int (bm_socket_write)(int sockfd, struct bm_data *bm_data, struct bm_socket_write va_list) {
-	if (sockfd < 0 || bm_data == NULL || \
-			bm_data->data == NULL || bm_data->size <= 0) {
-		va_list.status != NULL ? *(va_list.status) = 0 : 0;
-		return BM_ERROR_INVAL;
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static void advance_iovec(struct iovec **iov, int *n_iov, long n_byte) {
+	while (n_byte > 0 && *n_iov > 0) {
+		if ((size_t) n_byte < (*iov)->iov_len) {
+			(*iov)->iov_base = (char*) (*iov)->iov_base + n_byte;
+			(*iov)->iov_len = (*iov)->iov_len - n_byte;
+			return;
+		}
+
+		n_byte = n_byte - (*iov)->iov_len;
+		*iov = *iov + 1;
+		*n_iov = *n_iov - 1;
 	}
+}
 
+static void crc32c_iovec(struct iovec *iov, long n_byte, uint32_t *crc) {
+	for ( ; n_byte > 0; iov++) {
+		long chunk = (size_t) n_byte < iov->iov_len ? n_byte : (long) iov->iov_len;
+
+		*crc = update_crc32c(*crc, iov->iov_base, chunk);
+		n_byte = n_byte - chunk;
+	}
+}
+
+static int socket_writev(int sockfd, struct iovec *iov, int n_iov, long wr_size, struct bm_socket_write va_list) {
 	/* Variables needed for end routine */
 
 	int no_block = -1, sock_args = -1, sigfd = -1, return_status = BM_ERROR_NONE;
@@ -137,7 +161,7 @@ int (bm_socket_write)(int sockfd, struct bm_data *bm_data, struct bm_socket_writ
 
 		/* Commence the write operation */
 
-		wr_status = write(sockfd, bm_data->data + wr_counter, bm_data->size - wr_counter);
+		wr_status = writev(sockfd, iov, n_iov < IOV_MAX ? n_iov : IOV_MAX);
 
 		/* Check write return status */
 
@@ -164,12 +188,17 @@ int (bm_socket_write)(int sockfd, struct bm_data *bm_data, struct bm_socket_writ
 			}
 		}
 
-		if (wr_status > 0)
+		if (wr_status > 0) {
+			if (va_list.crc32c != NULL)
+				crc32c_iovec(iov, wr_status, va_list.crc32c);
+
 			wr_counter = wr_counter + wr_status;
+			advance_iovec(&iov, &n_iov, wr_status);
+		}
 
 		/* If fewer bytes are transfered */
 
-		if (wr_counter < bm_data->size) {
+		if (wr_counter < wr_size) {
 			if (isflag_set(va_list.flags, BM_MODE_AUTO_RETRY))
 				continue;
 			else {
@@ -207,6 +236,60 @@ write_return:
 	return return_status;
 }
 
+int (bm_socket_write)(int sockfd, struct bm_data *bm_data, struct bm_socket_write va_list) {
+	if (sockfd < 0 || bm_data == NULL || \
+			bm_data->data == NULL || bm_data->size <= 0) {
+		va_list.status != NULL ? *(va_list.status) = 0 : 0;
+		return BM_ERROR_INVAL;
+	}
+
+	struct iovec iov = {.iov_base = bm_data->data, .iov_len = bm_data->size};
+
+	return socket_writev(sockfd, &iov, 1, bm_data->size, va_list);
+}
+
+int (bm_socket_write_bag)(int sockfd, struct bm_bag *bm_bag, struct bm_socket_write_bag va_list) {
+	if (sockfd < 0 || bm_bag == NULL || bm_bag->n_pkt <= 0) {
+		va_list.status != NULL ? *(va_list.status) = 0 : 0;
+		return BM_ERROR_INVAL;
+	}
+
+	/* One gathered write per IOV_MAX bm_pocket{} */
+
+	struct iovec *iov = malloc(bm_bag->n_pkt * sizeof(struct iovec));
+
+	if (iov == NULL) {
+		va_list.status != NULL ? *(va_list.status) = 0 : 0;
+		return BM_ERROR_FATAL;
+	}
+
+	int n_iov = 0;
+	long wr_size = 0;
+
+	for (struct bm_pocket *bm_pocket = bm_bag->start; bm_pocket != NULL; bm_pocket = bm_pocket->next) {
+		if (bm_pocket->data == NULL || bm_pocket->size <= 0)
+			continue;
+
+		iov[n_iov].iov_base = bm_pocket->data;
+		iov[n_iov].iov_len = bm_pocket->size;
+		n_iov = n_iov + 1;
+		wr_size = wr_size + bm_pocket->size;
+	}
+
+	int return_status = BM_ERROR_INVAL;
+
+	if (wr_size > 0)
+		return_status = socket_writev(sockfd, iov, n_iov, wr_size, (struct bm_socket_write) \
+				{.status = va_list.status, .flags = va_list.flags, .io_timeout = va_list.io_timeout, \
+				.sigmask = va_list.sigmask, .crc32c = va_list.crc32c});
+	else
+		va_list.status != NULL ? *(va_list.status) = 0 : 0;
+
+	free(iov);
+
+	return return_status;
+}
+
 int (bm_socket_read)(int sockfd, struct bm_data *bm_data, struct bm_socket_read va_list) {
 	if (sockfd < 0 || bm_data == NULL || \
 			bm_data->data == NULL || bm_data->size <= 0) {
@@ -350,6 +433,9 @@ int (bm_socket_read)(int sockfd, struct bm_data *bm_data, struct bm_socket_read
 			}
 		}
 		else if (rd_status > 0) {
+			if (va_list.crc32c != NULL)	// While the bytes are still in cache
+				*(va_list.crc32c) = update_crc32c(*(va_list.crc32c), bm_data->data + rd_counter, rd_status);
+
 			rd_counter = rd_counter + rd_status;
 
 			if (rd_counter == bm_data->size) {
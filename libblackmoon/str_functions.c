@@ -195,6 +195,104 @@ char* (scopy)(struct bm_data* bm_data, char* seq_str, struct scopy va_list) {
 	return result;
 }
 
+static long span_bm_str(char *data, long size, long max_span, char *seq_str, int permit) {
+	char span_buf[2]; span_buf[1] = '\0';
+	long span_count = 0;
+
+	for ( ; span_count < size && span_count < max_span; span_count++) {
+		span_buf[0] = data[span_count];
+
+		if ((strstr(seq_str, span_buf) != NULL) != permit)
+			break;
+	}
+
+	return span_count;
+}
+
+static struct bm_slice* advance_bm_slice(struct bm_slice *bm_slice, long count, struct bm_flags flags, \
+		struct bm_slice **update) {
+	struct bm_slice *advanced = NULL;
+
+	/* Move the view or take a new one, the bytes stay in the bm_shared{} */
+
+	if (isflag_set(flags, BM_UPDATE_INPUT)) {
+		bm_slice->data = bm_slice->data + count;
+		bm_slice->size = bm_slice->size - count;
+
+		advanced = bm_slice;
+	}
+	else if (update != NULL) {
+		advanced = create_bm_slice(bm_slice->shared, bm_slice->data - bm_slice->shared->data + count, \
+				bm_slice->size - count);
+	}
+
+	if (isflag_set(flags, BM_FREE_INPUT)) {
+		free_bm_slice(&bm_slice);
+
+		if (isflag_set(flags, BM_UPDATE_INPUT))
+			advanced = NULL;
+	}
+
+	return advanced;
+}
+
+int (sseek_slice)(struct bm_slice *bm_slice, char *seq_str, struct sseek_slice va_list) {
+	if (bm_slice == NULL || bm_slice->data == NULL || bm_slice->size <= 0 || \
+			va_list.max_seek <= 0 || seq_str == NULL) {	// Invalid Request
+		va_list.update != NULL ? *(va_list.update) = bm_slice : 0;
+		return -1;
+	}
+
+	long seek_count = span_bm_str(bm_slice->data, bm_slice->size, va_list.max_seek, seq_str, \
+			isflag_set(va_list.flags, BM_SSEEK_PERMIT));
+
+	/* Send a sseek_slice update */
+
+	struct bm_slice *update = advance_bm_slice(bm_slice, seek_count, va_list.flags, va_list.update);
+
+	va_list.update != NULL ? *(va_list.update) = update : 0;
+
+	return seek_count;
+}
+
+char* (scopy_slice)(struct bm_slice *bm_slice, char *seq_str, struct scopy_slice va_list) {
+	if (bm_slice == NULL || bm_slice->data == NULL || bm_slice->size <= 0 || \
+			va_list.max_copy <= 0 || seq_str == NULL) {	// Invalid Request
+		va_list.update != NULL ? *(va_list.update) = bm_slice : 0;
+		return NULL;
+	}
+
+	long copy_count = span_bm_str(bm_slice->data, bm_slice->size, va_list.max_copy, seq_str, \
+			isflag_set(va_list.flags, BM_SCOPY_PERMIT));
+
+	/* Copy the results */
+
+	char *result = NULL;
+
+	if (copy_count) {
+		result = malloc(copy_count + 1);
+		memcpy(result, bm_slice->data, copy_count);
+		result[copy_count] = '\0';
+	}
+
+	/* Make a scopy_slice update */
+
+	struct bm_slice *update = advance_bm_slice(bm_slice, copy_count, va_list.flags, va_list.update);
+
+	/* If caller requested for any seeking operation */
+
+	if (isflag_set(va_list.flags, BM_SSEEK_DELIMIT)) {
+		sseek_slice(update, seq_str, .flags = set_flags(BM_UPDATE_INPUT, BM_SSEEK_DELIMIT));
+	}
+	else if (isflag_set(va_list.flags, BM_SSEEK_PERMIT)) {
+		sseek_slice(update, seq_str, .flags = set_flags(BM_UPDATE_INPUT, BM_SSEEK_PERMIT));
+	}
+
+	va_list.update != NULL ? *(va_list.update) = update : 0;
+
+	return result;
+}
+
 char* bm_strappend(char *first, ...) {
 	if (first == NULL)
 		return NULL;
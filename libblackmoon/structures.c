@@ -18,6 +18,9 @@
  *******************************************************************************/
 #include "blackmoon.h"
 #include <stdlib.h>
+#include <stddef.h>
+
+#define BM_FREE_BATCH 256
 
 struct bm_data* create_bm_data(long bm_data_size) {
 	if (bm_data_size < 0)
@@ -42,6 +45,36 @@ struct bm_data* create_bm_data(long bm_data_size) {
 	return bm_data;
 }
 
+struct bm_idata* create_inline_bm_data(long bm_data_size) {
+	if (bm_data_size < 0)
+		return NULL;
+
+	/* Header and payload in a single allocation */
+
+	struct bm_idata *bm_idata = calloc(1, sizeof(struct bm_idata) + bm_data_size);
+
+	if (bm_idata == NULL)
+		return NULL;
+
+	bm_idata->data = bm_data_size > 0 ? bm_idata->inl : NULL;
+	bm_idata->size = bm_data_size;
+
+	return bm_idata;
+}
+
+int free_inline_bm_data(struct bm_idata **_bm_idata) {
+	if (_bm_idata == NULL || *_bm_idata == NULL)
+		return BM_ERROR_INVAL;
+
+	/* Inline payload goes away with the header */
+
+	free(*_bm_idata);
+
+	*_bm_idata = NULL;
+
+	return BM_ERROR_NONE;
+}
+
 int (free_bm_data)(struct bm_data **_bm_data, struct free_bm_data va_list) {
 	if (_bm_data == NULL || *_bm_data == NULL)
 		return BM_ERROR_INVAL;
@@ -58,8 +91,177 @@ int (free_bm_data)(struct bm_data **_bm_data, struct free_bm_data va_list) {
 	return fd_status;
 }
 
-struct bm_bag* create_bm_bag() {
-	return calloc(1, sizeof(struct bm_bag));
+struct bm_bag* (create_bm_bag)(struct create_bm_bag va_list) {
+	struct bm_bag *bm_bag = calloc(1, sizeof(struct bm_bag));
+
+	if (bm_bag == NULL)
+		return NULL;
+
+	bm_bag->arena = va_list.arena;
+
+	return bm_bag;
+}
+
+static int bm_arena_class(long bm_pocket_size) {
+	int p_class = 0;
+
+	for (long c_size = 16; c_size < bm_pocket_size && p_class < BM_ARENA_CLASSES; \
+			c_size = c_size << 1)
+		p_class++;
+
+	return p_class < BM_ARENA_CLASSES ? p_class : -1;
+}
+
+static void release_bm_pocket(struct bm_pocket *bm_pocket) {
+	if (bm_pocket->arena == NULL) {
+		free(bm_pocket);
+		return;
+	}
+
+	/* Arena bm_pocket{} are recycled through the bm_arena{} freelist, for any bm_bag{} on it */
+
+	int p_class = bm_arena_class(bm_pocket->cap);
+
+	if (p_class >= 0 && bm_pocket->cap == 16L << p_class) {
+		bm_pocket->next = bm_pocket->arena->f_pkt[p_class];
+		bm_pocket->arena->f_pkt[p_class] = bm_pocket;
+	}
+}
+
+/* bm_index{} helpers, slots are 1-based and follow the bm_bag{} order */
+
+static void free_bm_index(struct bm_bag *bm_bag) {
+	if (bm_bag->index == NULL)
+		return;
+
+	free(bm_bag->index->pkt);
+	free(bm_bag->index->tree);
+	free(bm_bag->index);
+	bm_bag->index = NULL;
+}
+
+static void add_bm_tree(struct bm_index *bm_index, long slot, long delta) {
+	for ( ; slot <= bm_index->cap; slot = slot + (slot & -slot))
+		bm_index->tree[slot] = bm_index->tree[slot] + delta;
+}
+
+static int build_bm_index(struct bm_bag *bm_bag, long cap) {
+	struct bm_index *bm_index = bm_bag->index;
+
+	/* Resize the slot arrays, cap is always a power of two */
+
+	if (cap != bm_index->cap) {
+		struct bm_pocket **pkt = realloc(bm_index->pkt, (cap + 1) * sizeof(struct bm_pocket*));
+
+		if (pkt == NULL)
+			return BM_ERROR_FATAL;
+
+		bm_index->pkt = pkt;
+
+		long *tree = realloc(bm_index->tree, (cap + 1) * sizeof(long));
+
+		if (tree == NULL)
+			return BM_ERROR_FATAL;
+
+		bm_index->tree = tree;
+		bm_index->cap = cap;
+	}
+
+	/* Compact the live bm_pocket{} and rebuild the tree in O(n) */
+
+	memset(bm_index->tree, 0, (cap + 1) * sizeof(long));
+
+	long slot = 0;
+	bm_index->size = 0;
+
+	for (struct bm_pocket *bm_pocket = bm_bag->start; bm_pocket != NULL; \
+			bm_pocket = bm_pocket->next) {
+		if (slot == cap)
+			return BM_ERROR_FATAL;
+
+		slot = slot + 1;
+		bm_pocket->idx = slot;
+		bm_index->pkt[slot] = bm_pocket;
+		bm_index->tree[slot] = bm_pocket->size;
+		bm_index->size = bm_index->size + bm_pocket->size;
+	}
+
+	for (long at = 1; at <= cap; at++) {
+		long up = at + (at & -at);
+
+		if (up <= cap)
+			bm_index->tree[up] = bm_index->tree[up] + bm_index->tree[at];
+	}
+
+	if (slot != bm_bag->n_pkt)	// The walk and the bm_bag{} disagree, do not trust the index
+		return BM_ERROR_FATAL;
+
+	bm_index->n_slot = slot;
+	bm_index->n_dead = 0;
+
+	return BM_ERROR_NONE;
+}
+
+static void index_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket) {
+	struct bm_index *bm_index = bm_bag->index;
+
+	/* bm_pocket{} is already linked, so a rebuild picks it up as well */
+
+	if (bm_index->n_slot == bm_index->cap) {
+		long cap = bm_index->cap;
+
+		while (cap < 2 * bm_bag->n_pkt)
+			cap = cap << 1;
+
+		if (build_bm_index(bm_bag, cap) != BM_ERROR_NONE)
+			free_bm_index(bm_bag);	// Fall back to walking the bm_bag{}
+
+		return;
+	}
+
+	bm_index->n_slot = bm_index->n_slot + 1;
+	bm_pocket->idx = bm_index->n_slot;
+	bm_index->pkt[bm_pocket->idx] = bm_pocket;
+	bm_index->size = bm_index->size + bm_pocket->size;
+
+	add_bm_tree(bm_index, bm_pocket->idx, bm_pocket->size);
+}
+
+static void unindex_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket) {
+	struct bm_index *bm_index = bm_bag->index;
+
+	/* Leave a zero sized tombstone, compact once half the slots are dead */
+
+	add_bm_tree(bm_index, bm_pocket->idx, -bm_pocket->size);
+
+	bm_index->pkt[bm_pocket->idx] = NULL;
+	bm_index->size = bm_index->size - bm_pocket->size;
+	bm_index->n_dead = bm_index->n_dead + 1;
+
+	if (bm_index->n_dead > 64 && 2 * bm_index->n_dead > bm_index->n_slot) {
+		if (build_bm_index(bm_bag, bm_index->cap) != BM_ERROR_NONE)
+			free_bm_index(bm_bag);
+	}
+}
+
+static int bm_pocket_owns_data(struct bm_pocket *bm_pocket) {
+	/* Only a bm_pocket{} created with inline room (cap > 0) can hold data in inl[] */
+
+	return (bm_pocket->cap > 0 && bm_pocket->data == bm_pocket->inl) || \
+			(bm_pocket->arena != NULL && bm_pocket->data == NULL);
+}
+
+static int drop_bm_pocket_data(struct bm_pocket *bm_pocket, freeing_func *ffunc) {
+	/* bm_pocket{}->ffunc, if any, takes precedence over the caller's */
+
+	if (bm_pocket->ffunc != NULL)
+		ffunc = bm_pocket->ffunc;
+
+	if (ffunc == NULL || bm_pocket_owns_data(bm_pocket))
+		return BM_ERROR_NONE;
+
+	return (*ffunc)(bm_pocket->owner != NULL ? bm_pocket->owner : bm_pocket->data) \
+			!= BM_ERROR_NONE ? BM_ERROR_INVAL : BM_ERROR_NONE;
 }
 
 int (free_bm_bag)(struct bm_bag** _bm_bag, struct free_bm_bag va_list) {
@@ -68,46 +270,103 @@ int (free_bm_bag)(struct bm_bag** _bm_bag, struct free_bm_bag va_list) {
 
 	struct bm_pocket *at = NULL, *prev = NULL;
 
-	/* Iterate and free the bm_pocket{} */
+	/* Iterate and free the bm_pocket{}, batching data for va_list.bfunc */
 	int fb_status = BM_ERROR_NONE;
+	void *batch[BM_FREE_BATCH];
+	long n_batch = 0;
 
 	for (at = (*_bm_bag)->end; at != NULL; at = prev) {
 		prev = at->prev;
-		if (va_list.ffunc != NULL &&(*(va_list.ffunc))(at->data) != BM_ERROR_NONE)
+		if (va_list.bfunc != NULL && at->ffunc == NULL && !bm_pocket_owns_data(at)) {
+			batch[n_batch++] = at->data;
+
+			if (n_batch == BM_FREE_BATCH) {
+				if ((*(va_list.bfunc))(batch, n_batch) != BM_ERROR_NONE)
+					fb_status = BM_ERROR_INVAL;
+				n_batch = 0;
+			}
+		}
+		else if (drop_bm_pocket_data(at, va_list.ffunc) != BM_ERROR_NONE)
 			fb_status = BM_ERROR_INVAL;
-		free(at);
+		release_bm_pocket(at);
 	}
 
+	if (n_batch > 0 && (*(va_list.bfunc))(batch, n_batch) != BM_ERROR_NONE)
+		fb_status = BM_ERROR_INVAL;
+
+	free_bm_index(*_bm_bag);
 	free(*_bm_bag);
 	*_bm_bag = NULL;
 
 	return fb_status;
 }
 
-int append_bm_pocket(struct bm_bag* bm_bag, long bm_pocket_size) {
-	if (bm_bag == NULL)
-		return BM_ERROR_INVAL;
+static struct bm_pocket* create_bm_pocket(struct bm_bag *bm_bag, long bm_pocket_size) {
+	struct bm_pocket *bm_pocket = NULL;
 
-	/* Create a new bm_pocket{} */
+	int p_class = bm_bag->arena != NULL ? bm_arena_class(bm_pocket_size) : -1;
 
-	struct bm_pocket *bm_pocket = malloc(sizeof(struct bm_pocket));
+	if (p_class >= 0) {
+		/* Reuse a recycled bm_pocket{} or carve node and data together */
 
-	if (bm_pocket == NULL)
-		return BM_ERROR_FATAL;
+		if (bm_bag->arena->f_pkt[p_class] != NULL) {
+			bm_pocket = bm_bag->arena->f_pkt[p_class];
+			bm_bag->arena->f_pkt[p_class] = bm_pocket->next;
+		}
+		else {
+			bm_pocket = carve_bm_arena(bm_bag->arena, sizeof(struct bm_pocket) + (16L << p_class));
+
+			if (bm_pocket == NULL)
+				return NULL;
 
-	/* Allocate data for bm_pocket{}->data */
+			bm_pocket->arena = bm_bag->arena;
+			bm_pocket->cap = 16L << p_class;
+		}
 
-	bm_pocket->data = bm_pocket_size > 0 ? malloc(bm_pocket_size) : NULL;
+		bm_pocket->data = bm_pocket_size > 0 ? bm_pocket->inl : NULL;
+	}
+	else if (bm_pocket_size > 0 && (bm_pocket_size <= BM_POCKET_INLINE_MAX || \
+			bm_bag->arena != NULL)) {	// Arena sizes past the last class too, freed on delete
+		/* Small bm_pocket{}->data lives inline, right after the node */
 
-	if (bm_pocket->data == NULL && bm_pocket_size > 0) {
-		free(bm_pocket);
-		return BM_ERROR_FATAL;
+		bm_pocket = malloc(sizeof(struct bm_pocket) + bm_pocket_size);
+
+		if (bm_pocket == NULL)
+			return NULL;
+
+		bm_pocket->data = bm_pocket->inl;
+		bm_pocket->arena = NULL;
+		bm_pocket->cap = bm_pocket_size;
+	}
+	else {
+		/* Create a new bm_pocket{} */
+
+		bm_pocket = malloc(sizeof(struct bm_pocket));
+
+		if (bm_pocket == NULL)
+			return NULL;
+
+		/* Allocate data for bm_pocket{}->data */
+
+		bm_pocket->data = bm_pocket_size > 0 ? malloc(bm_pocket_size) : NULL;
+
+		if (bm_pocket->data == NULL && bm_pocket_size > 0) {
+			free(bm_pocket);
+			return NULL;
+		}
+
+		bm_pocket->arena = NULL;
+		bm_pocket->cap = 0;
 	}
 
 	bm_pocket->size = bm_pocket_size > 0 ? bm_pocket_size : 0;
+	bm_pocket->ffunc = NULL;
+	bm_pocket->owner = NULL;
 
-	/* Append bm_pocket{} to bm_bag{} */
+	return bm_pocket;
+}
 
+static void link_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket) {
 	if (bm_bag->n_pkt == 0) {	// If bm_bag{} is empty
 		bm_pocket->prev = NULL;
 		bm_pocket->next = NULL;
@@ -125,17 +384,29 @@ int append_bm_pocket(struct bm_bag* bm_bag, long bm_pocket_size) {
 		bm_bag->n_pkt = bm_bag->n_pkt + 1;
 	}
 
-	return BM_ERROR_NONE;
+	if (bm_bag->index != NULL)
+		index_bm_pocket(bm_bag, bm_pocket);
 }
 
-int (delete_bm_pocket)(struct bm_bag* bm_bag, struct bm_pocket** _bm_pocket, struct delete_bm_pocket va_list) {
-	if (bm_bag == NULL || _bm_pocket == NULL)
+int append_bm_pocket(struct bm_bag* bm_bag, long bm_pocket_size) {
+	if (bm_bag == NULL)
 		return BM_ERROR_INVAL;
 
-	struct bm_pocket *bm_pocket = *_bm_pocket;
+	/* Create a new bm_pocket{} */
 
-	int db_status = BM_ERROR_NONE;
+	struct bm_pocket *bm_pocket = create_bm_pocket(bm_bag, bm_pocket_size);
+
+	if (bm_pocket == NULL)
+		return BM_ERROR_FATAL;
+
+	/* Append bm_pocket{} to bm_bag{} */
+
+	link_bm_pocket(bm_bag, bm_pocket);
+
+	return BM_ERROR_NONE;
+}
 
+static void unlink_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket) {
 	/* Update the bm_bag{} depending on the position of bm_pocket{} */
 
 	if (bm_pocket->prev == NULL && \
@@ -158,18 +429,155 @@ int (delete_bm_pocket)(struct bm_bag* bm_bag, struct bm_pocket** _bm_pocket, str
 
 	bm_bag->n_pkt = bm_bag->n_pkt - 1;
 
+	if (bm_bag->index != NULL)	// After unlinking, a compaction must not index bm_pocket{} again
+		unindex_bm_pocket(bm_bag, bm_pocket);
+}
+
+int (delete_bm_pocket)(struct bm_bag* bm_bag, struct bm_pocket** _bm_pocket, struct delete_bm_pocket va_list) {
+	if (bm_bag == NULL || _bm_pocket == NULL)
+		return BM_ERROR_INVAL;
+
+	struct bm_pocket *bm_pocket = *_bm_pocket;
+
+	int db_status = BM_ERROR_NONE;
+
+	unlink_bm_pocket(bm_bag, bm_pocket);
+
 	/* Free bm_pocket{} */
 
-	if (va_list.ffunc != NULL && (*(va_list.ffunc))(bm_pocket->data) != BM_ERROR_NONE)
-		db_status = BM_ERROR_INVAL;
+	db_status = drop_bm_pocket_data(bm_pocket, va_list.ffunc);
 
-	free(bm_pocket);
+	release_bm_pocket(bm_pocket);
 
 	*_bm_pocket = NULL;
 
 	return db_status;
 }
 
+int detach_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket) {
+	if (bm_bag == NULL || bm_pocket == NULL || bm_bag->n_pkt <= 0)
+		return BM_ERROR_INVAL;
+
+	unlink_bm_pocket(bm_bag, bm_pocket);
+
+	bm_pocket->prev = NULL;
+	bm_pocket->next = NULL;
+
+	return BM_ERROR_NONE;
+}
+
+int attach_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket) {
+	if (bm_bag == NULL || bm_pocket == NULL)
+		return BM_ERROR_INVAL;
+
+	link_bm_pocket(bm_bag, bm_pocket);
+
+	return BM_ERROR_NONE;
+}
+
+_Static_assert(offsetof(struct bm_buf, data) == offsetof(struct bm_data, data) && \
+		offsetof(struct bm_buf, size) == offsetof(struct bm_data, size), \
+		"struct bm_buf must stay (struct bm_data*) compatible");
+
+struct bm_buf* create_bm_buf(long bm_buf_cap) {
+	if (bm_buf_cap < 0)
+		return NULL;
+
+	struct bm_buf *bm_buf = calloc(1, sizeof(struct bm_buf));
+
+	if (bm_buf == NULL)
+		return NULL;
+
+	if (reserve_bm_buf(bm_buf, bm_buf_cap) != BM_ERROR_NONE) {
+		free(bm_buf);
+		return NULL;
+	}
+
+	return bm_buf;
+}
+
+int reserve_bm_buf(struct bm_buf *bm_buf, long bm_buf_cap) {
+	if (bm_buf == NULL || bm_buf_cap < 0)
+		return BM_ERROR_INVAL;
+
+	if (bm_buf_cap <= bm_buf->cap)
+		return BM_ERROR_NONE;
+
+	void *data = realloc(bm_buf->data, bm_buf_cap);
+
+	if (data == NULL)
+		return BM_ERROR_FATAL;
+
+	bm_buf->data = data;
+	bm_buf->cap = bm_buf_cap;
+
+	return BM_ERROR_NONE;
+}
+
+int append_bm_buf(struct bm_buf *bm_buf, void *data, long data_size) {
+	if (bm_buf == NULL || data_size < 0 || (data == NULL && data_size > 0) || \
+			data_size > LONG_MAX - bm_buf->size)
+		return BM_ERROR_INVAL;
+
+	/* Grow geometrically so that appends are amortized O(1) */
+
+	if (bm_buf->size + data_size > bm_buf->cap) {
+		long n_cap = bm_buf->cap < 64 ? 64 : bm_buf->cap;
+
+		while (n_cap < bm_buf->size + data_size)
+			n_cap = n_cap > LONG_MAX / 2 ? LONG_MAX : n_cap * 2;
+
+		int rs_status = reserve_bm_buf(bm_buf, n_cap);
+
+		if (rs_status != BM_ERROR_NONE)
+			return rs_status;
+	}
+
+	if (data_size > 0)
+		memcpy(bm_buf->data + bm_buf->size, data, data_size);
+
+	bm_buf->size = bm_buf->size + data_size;
+
+	return BM_ERROR_NONE;
+}
+
+int shrink_bm_buf(struct bm_buf *bm_buf) {
+	if (bm_buf == NULL || bm_buf->size < 0)
+		return BM_ERROR_INVAL;
+
+	if (bm_buf->size == bm_buf->cap)
+		return BM_ERROR_NONE;
+
+	if (bm_buf->size == 0) {
+		free(bm_buf->data);
+		bm_buf->data = NULL;
+		bm_buf->cap = 0;
+
+		return BM_ERROR_NONE;
+	}
+
+	void *data = realloc(bm_buf->data, bm_buf->size);
+
+	if (data == NULL)
+		return BM_ERROR_FATAL;
+
+	bm_buf->data = data;
+	bm_buf->cap = bm_buf->size;
+
+	return BM_ERROR_NONE;
+}
+
+int free_bm_buf(struct bm_buf **_bm_buf) {
+	if (_bm_buf == NULL || *_bm_buf == NULL)
+		return BM_ERROR_INVAL;
+
+	free((*_bm_buf)->data);
+	free(*_bm_buf);
+	*_bm_buf = NULL;
+
+	return BM_ERROR_NONE;
+}
+
 int place_bm_data(struct bm_bag* bm_bag, struct bm_data* bm_data) {
 	if (bm_bag == NULL || bm_data == NULL)
 		return BM_ERROR_INVAL;
@@ -190,14 +598,131 @@ int place_bm_data(struct bm_bag* bm_bag, struct bm_data* bm_data) {
 	return BM_ERROR_NONE;
 }
 
-struct bm_data* flatten_bm_bag(struct bm_bag *bm_bag)
-{
-	struct bm_data* bm_data = (struct bm_data*) calloc(1, sizeof(struct bm_data));
+int adopt_bm_data(struct bm_bag *bm_bag, struct bm_data **_bm_data) {
+	if (bm_bag == NULL || _bm_data == NULL || *_bm_data == NULL)
+		return BM_ERROR_INVAL;
+
+	struct bm_data *bm_data = *_bm_data;
+
+	/* Link a bare bm_pocket{} to the existing buffer, release the header */
+
+	struct bm_pocket *bm_pocket = create_bm_pocket(bm_bag, 0);
+
+	if (bm_pocket == NULL)
+		return BM_ERROR_FATAL;
+
+	bm_pocket->data = bm_data->data;
+	bm_pocket->size = bm_data->data == NULL || bm_data->size <= 0 ? 0 : bm_data->size;
+
+	link_bm_pocket(bm_bag, bm_pocket);
+
+	free(bm_data);
+	*_bm_data = NULL;
+
+	return BM_ERROR_NONE;
+}
+
+int adopt_inline_bm_data(struct bm_bag *bm_bag, struct bm_idata **_bm_idata) {
+	if (bm_bag == NULL || _bm_idata == NULL || *_bm_idata == NULL)
+		return BM_ERROR_INVAL;
+
+	struct bm_idata *bm_idata = *_bm_idata;
+
+	/* Inline payload keeps its header, both go through bm_free_inline() */
 
+	struct bm_pocket *bm_pocket = create_bm_pocket(bm_bag, 0);
+
+	if (bm_pocket == NULL)
+		return BM_ERROR_FATAL;
+
+	bm_pocket->data = bm_idata->data;
+	bm_pocket->size = bm_idata->data == NULL || bm_idata->size <= 0 ? 0 : bm_idata->size;
+
+	link_bm_pocket(bm_bag, bm_pocket);
+
+	if (bm_idata->data != NULL)
+		bm_pocket->ffunc = bm_free_inline;
+	else
+		free(bm_idata);
+
+	*_bm_idata = NULL;
+
+	return BM_ERROR_NONE;
+}
+
+static int bm_free_none(void *data) {
+	(void) data;
+
+	return BM_ERROR_NONE;
+}
+
+int (borrow_bm_data)(struct bm_bag *bm_bag, struct bm_data *bm_data, struct borrow_bm_data va_list) {
+	if (bm_bag == NULL || bm_data == NULL)
+		return BM_ERROR_INVAL;
+
+	/* Reference bm_data{}->data without copying */
+
+	struct bm_pocket *bm_pocket = create_bm_pocket(bm_bag, 0);
+
+	if (bm_pocket == NULL)
+		return BM_ERROR_FATAL;
+
+	bm_pocket->data = bm_data->data;
+	bm_pocket->size = bm_data->data == NULL || bm_data->size <= 0 ? 0 : bm_data->size;
+	bm_pocket->ffunc = va_list.ffunc != NULL ? va_list.ffunc : bm_free_none;
+
+	link_bm_pocket(bm_bag, bm_pocket);
+
+	return BM_ERROR_NONE;
+}
+
+int index_bm_bag(struct bm_bag *bm_bag) {
+	if (bm_bag == NULL)
+		return BM_ERROR_INVAL;
+
+	if (bm_bag->index != NULL)
+		return BM_ERROR_NONE;
+
+	bm_bag->index = calloc(1, sizeof(struct bm_index));
+
+	if (bm_bag->index == NULL)
+		return BM_ERROR_FATAL;
+
+	/* Room for twice the current bm_pocket{} count */
+
+	long cap = 16;
+
+	while (cap < 2 * bm_bag->n_pkt)
+		cap = cap << 1;
+
+	if (build_bm_index(bm_bag, cap) != BM_ERROR_NONE) {
+		free_bm_index(bm_bag);
+		return BM_ERROR_FATAL;
+	}
+
+	return BM_ERROR_NONE;
+}
+
+int resize_bm_pocket(struct bm_bag *bm_bag, struct bm_pocket *bm_pocket, long bm_pocket_size) {
+	if (bm_bag == NULL || bm_pocket == NULL || bm_pocket_size < 0)
+		return BM_ERROR_INVAL;
+
+	if (bm_bag->index != NULL) {
+		add_bm_tree(bm_bag->index, bm_pocket->idx, bm_pocket_size - bm_pocket->size);
+		bm_bag->index->size = bm_bag->index->size + bm_pocket_size - bm_pocket->size;
+	}
+
+	bm_pocket->size = bm_pocket_size;
+
+	return BM_ERROR_NONE;
+}
+
+long size_bm_bag(struct bm_bag *bm_bag) {
 	if (bm_bag == NULL)
-		return bm_data;
+		return -1;
 
-	/* Compute the memory requirements of new bm_data{} */
+	if (bm_bag->index != NULL)
+		return bm_bag->index->size;
 
 	long t_size = 0;
 
@@ -206,22 +731,71 @@ struct bm_data* flatten_bm_bag(struct bm_bag *bm_bag)
 		t_size = t_size + bm_pocket->size;
 	}
 
-	if (t_size <= 0)
-		return bm_data;
+	return t_size;
+}
+
+struct bm_pocket* locate_bm_bag(struct bm_bag *bm_bag, long offset, long *p_offset) {
+	if (bm_bag == NULL || offset < 0)
+		return NULL;
+
+	if (bm_bag->index == NULL) {	// Walk the bm_bag{}
+		for (struct bm_pocket* bm_pocket = bm_bag->start; bm_pocket != NULL; \
+				bm_pocket = bm_pocket->next) {
+			if (offset < bm_pocket->size) {
+				p_offset != NULL ? *p_offset = offset : 0;
+				return bm_pocket;
+			}
+
+			offset = offset - bm_pocket->size;
+		}
+
+		return NULL;
+	}
+
+	struct bm_index *bm_index = bm_bag->index;
 
-	/* Copy the data in bm_bag{} to bm_data{}->data */
+	if (offset >= bm_index->size)
+		return NULL;
 
-	bm_data->data = malloc(t_size);
+	/* Descend the tree for the first slot whose prefix sum exceeds offset */
 
-	if (bm_data->data == NULL)
-		return bm_data;
+	long slot = 0;
 
-	for (struct bm_pocket* bm_pocket = bm_bag->start; bm_pocket != NULL; bm_pocket = bm_pocket->next) {
-		if (bm_pocket->data != NULL && bm_pocket->size > 0) {
-			memcpy(bm_data->data + bm_data->size, bm_pocket->data, bm_pocket->size);
-			bm_data->size = bm_data->size + bm_pocket->size;
+	for (long step = bm_index->cap; step > 0; step = step >> 1) {
+		if (slot + step <= bm_index->n_slot && bm_index->tree[slot + step] <= offset) {
+			slot = slot + step;
+			offset = offset - bm_index->tree[slot];
 		}
 	}
 
-	return bm_data;
+	p_offset != NULL ? *p_offset = offset : 0;
+
+	return bm_index->pkt[slot + 1];
+}
+
+long copy_bm_bag(struct bm_bag *bm_bag, long offset, void *buf, long length) {
+	if (bm_bag == NULL || buf == NULL || offset < 0 || length < 0)
+		return -1;
+
+	long p_offset = 0, c_size = 0, cp_count = 0;
+
+	/* Copy out from the located bm_pocket{} onwards */
+
+	for (struct bm_pocket *bm_pocket = locate_bm_bag(bm_bag, offset, &p_offset); \
+			bm_pocket != NULL && cp_count < length; bm_pocket = bm_pocket->next) {
+		if (bm_pocket->data == NULL || bm_pocket->size <= p_offset) {
+			p_offset = 0;
+			continue;
+		}
+
+		c_size = bm_pocket->size - p_offset < length - cp_count ? \
+				bm_pocket->size - p_offset : length - cp_count;
+
+		memcpy(buf + cp_count, bm_pocket->data + p_offset, c_size);
+
+		cp_count = cp_count + c_size;
+		p_offset = 0;
+	}
+
+	return cp_count;
 }
@@ -0,0 +1,355 @@
+/*******************************************************************************
+ * Copyright (C) 2020 - 2021, Mohith Reddy <dev.m0hithreddy@gmail.com>
+ *
+ * This file is part of blackmoon-lib <https://github.com/m0hithreddy/blackmoon-lib>
+ *
+ * blackmoon-lib is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * blackmoon-lib is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+#include "blackmoon.h"
+#include <stdlib.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define BM_VARINT_X86
+#endif
+
+#define BM_VARINT_MAX 10
+
+static inline uint64_t load_le64(const uint8_t *bytes) {
+	uint64_t word;
+
+	memcpy(&word, bytes, sizeof(word));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	return word;
+}
+
+static inline void store_le64(uint8_t *bytes, uint64_t word) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+
+	memcpy(bytes, &word, sizeof(word));
+}
+
+/* Gather the low seven bits of each byte of word, and the reverse */
+
+static inline uint64_t compact_varint(uint64_t word) {
+	word = word & 0x7F7F7F7F7F7F7F7FULL;
+	word = ((word & 0x7F007F007F007F00ULL) >> 1) | (word & 0x007F007F007F007FULL);
+	word = ((word & 0x3FFF00003FFF0000ULL) >> 2) | (word & 0x00003FFF00003FFFULL);
+	return ((word & 0x0FFFFFFF00000000ULL) >> 4) | (word & 0x000000000FFFFFFFULL);
+}
+
+static inline uint64_t spread_varint(uint64_t value) {	// value < 2^56
+	value = ((value & 0x00FFFFFFF0000000ULL) << 4) | (value & 0x000000000FFFFFFFULL);
+	value = ((value & 0x0FFFC0000FFFC000ULL) << 2) | (value & 0x00003FFF00003FFFULL);
+	return ((value & 0x3F803F803F803F80ULL) << 1) | (value & 0x007F007F007F007FULL);
+}
+
+#ifdef BM_VARINT_X86
+__attribute__((target("bmi2")))
+static inline uint64_t compact_varint_bmi2(uint64_t word) {
+	return _pext_u64(word, 0x7F7F7F7F7F7F7F7FULL);
+}
+
+__attribute__((target("bmi2")))
+static inline uint64_t spread_varint_bmi2(uint64_t value) {
+	return _pdep_u64(value, 0x7F7F7F7F7F7F7F7FULL);
+}
+
+static inline int bm_varint_bmi2() {	// pext and pdep are microcoded on Zen 1 and 2
+	return __builtin_cpu_supports("bmi2") && !__builtin_cpu_is("znver1") && !__builtin_cpu_is("znver2");
+}
+#endif
+
+int varint_size(uint64_t value) {
+	return ((63 - __builtin_clzll(value | 1)) * 9 + 73) >> 6;	// (bits - 1) / 7 + 1
+}
+
+int int_to_varint(uint64_t value, void *bytes) {
+	uint8_t *out = bytes;
+	int n_byte = 0;
+
+	for ( ; value >= 0x80; value = value >> 7)
+		out[n_byte++] = value | 0x80;
+
+	out[n_byte++] = value;
+
+	return n_byte;
+}
+
+int varint_to_int(void *bytes, long avail, uint64_t *value) {
+	const uint8_t *in = bytes;
+
+	/* Up to eight bytes at once: terminator from the high bits, payload compacted */
+
+	if (avail >= 8) {
+		uint64_t word = load_le64(in), term = ~word & 0x8080808080808080ULL;
+
+		if (term != 0) {
+			int n_byte = __builtin_ctzll(term) / 8 + 1;
+
+			*value = compact_varint(word & (~0ULL >> (64 - 8 * n_byte)));
+			return n_byte;
+		}
+	}
+
+	*value = 0;
+
+	for (int i = 0; i < BM_VARINT_MAX; i++) {
+		if (i == avail)
+			return 0;
+
+		if (i == BM_VARINT_MAX - 1 && in[i] > 1)
+			return -1;	// Overflows 64 bits
+
+		*value = *value | ((uint64_t) (in[i] & 0x7F) << (7 * i));
+
+		if ((in[i] & 0x80) == 0)
+			return i + 1;
+	}
+
+	return -1;
+}
+
+/* Word-at-a-time loops, instantiated once per compaction so BMI2 can be picked at runtime */
+
+#define BM_VARINT_ENCODE(name, spread, ...) \
+	__VA_ARGS__ static long name(uint8_t *out, long at, long size, uint64_t *values, long *n_value, int zigzag) { \
+		long n = 0, n_total = *n_value, n_wide = n_total - 7, at_wide = size - 8 - 7 * BM_VARINT_MAX; \
+		for ( ; n < n_total; n++) { \
+			uint64_t value = zigzag ? int_to_zigzag((int64_t) values[n]) : values[n]; \
+			if (value < 0x80 && at < size) { \
+				out[at++] = value; \
+				continue; \
+			} \
+			int n_byte = varint_size(value); \
+			if (n_byte > size - at) \
+				break; \
+			if (n_byte <= 8 && n < n_wide && at <= at_wide) /* Seven more values overwrite the slack */ \
+				store_le64(out + at, spread(value) | (0x8080808080808080ULL >> (72 - 8 * n_byte))); \
+			else \
+				int_to_varint(value, out + at); \
+			at = at + n_byte; \
+		} \
+		*n_value = n; \
+		return at; \
+	}
+
+#define BM_VARINT_DECODE(name, compact, ...) \
+	__VA_ARGS__ static int name(const uint8_t *in, uint64_t *values, int *n_value, unsigned int term, int zigzag) { \
+		int n = 0, start = 0; \
+		for ( ; term != 0; term = term & (term - 1)) { \
+			int end = __builtin_ctz(term), n_byte = end - start + 1; \
+			if (n_byte > 8) \
+				break; \
+			uint64_t value = compact(load_le64(in + start) & (~0ULL >> (64 - 8 * n_byte))); \
+			values[n++] = zigzag ? (uint64_t) zigzag_to_int(value) : value; \
+			start = end + 1; \
+		} \
+		*n_value = n; \
+		return start; \
+	}
+
+BM_VARINT_ENCODE(encode_words, spread_varint)
+
+#ifdef BM_VARINT_X86
+BM_VARINT_DECODE(decode_words, compact_varint)
+BM_VARINT_ENCODE(encode_words_bmi2, spread_varint_bmi2, __attribute__((target("bmi2"))))
+BM_VARINT_DECODE(decode_words_bmi2, compact_varint_bmi2, __attribute__((target("bmi2"))))
+#endif
+
+int (encode_bm_varints)(struct bm_data *bm_data, uint64_t *values, long *n_value, struct encode_bm_varints va_list) {
+	if (bm_data == NULL || n_value == NULL || *n_value < 0 || (values == NULL && *n_value > 0) || \
+			va_list.offset < 0 || va_list.offset > bm_data->size || (bm_data->data == NULL && bm_data->size > 0)) {
+		va_list.consumed != NULL ? *(va_list.consumed) = 0 : 0;
+		return BM_ERROR_INVAL;
+	}
+
+	long n = *n_value, at;
+
+#ifdef BM_VARINT_X86
+	if (bm_varint_bmi2())
+		at = encode_words_bmi2(bm_data->data, va_list.offset, bm_data->size, values, &n, va_list.zigzag);
+	else
+#endif
+		at = encode_words(bm_data->data, va_list.offset, bm_data->size, values, &n, va_list.zigzag);
+
+	int return_status = n < *n_value ? BM_ERROR_BUFFER_FULL : BM_ERROR_NONE;
+
+	*n_value = n;
+	va_list.consumed != NULL ? *(va_list.consumed) = at - va_list.offset : 0;
+
+	return return_status;
+}
+
+#ifdef BM_VARINT_X86
+
+/* Masked VByte: the continuation bits of 8 bytes index a pshufb pattern for their 1 and 2 byte values */
+
+struct varint_shuffle {
+	uint8_t shuffle[16];
+	uint8_t n_value;
+	uint8_t n_byte;
+};
+
+static struct varint_shuffle varint_shuffles[256];
+static pthread_once_t varint_shuffles_once = PTHREAD_ONCE_INIT;
+
+static void init_varint_shuffles() {
+	for (int cont = 0; cont < 256; cont++) {
+		struct varint_shuffle *entry = varint_shuffles + cont;
+		int at = 0;
+
+		memset(entry->shuffle, 0x80, sizeof(entry->shuffle));
+
+		while (at < 8) {
+			int n_byte = (cont >> at & 1) == 0 ? 1 : (at < 7 && (cont >> (at + 1) & 1) == 0 ? 2 : 0);
+
+			if (n_byte == 0)
+				break;
+
+			entry->shuffle[2 * entry->n_value] = at;
+
+			if (n_byte == 2)
+				entry->shuffle[2 * entry->n_value + 1] = at + 1;
+
+			entry->n_value = entry->n_value + 1;
+			at = at + n_byte;
+		}
+
+		entry->n_byte = at;
+	}
+}
+
+static inline int bm_varint_ssse3() {
+	if (!__builtin_cpu_supports("ssse3"))
+		return 0;
+
+	pthread_once(&varint_shuffles_once, init_varint_shuffles);
+
+	return 1;
+}
+
+__attribute__((target("ssse3")))
+static int decode_shuffle_ssse3(const uint8_t *in, uint64_t *values, int cont, int zigzag) {	// Values written
+	const struct varint_shuffle *entry = varint_shuffles + (cont & 0xFF);
+
+	if (entry->n_value == 0)
+		return 0;
+
+	__m128i lanes = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) in), \
+			_mm_loadu_si128((const __m128i*) entry->shuffle));
+
+	lanes = _mm_or_si128(_mm_and_si128(lanes, _mm_set1_epi16(0x007F)), \
+			_mm_srli_epi16(_mm_and_si128(lanes, _mm_set1_epi16(0x7F00)), 1));
+
+	/* Widen eight 16-bit lanes, sign extending the zigzag decoded ones */
+
+	__m128i fill = _mm_setzero_si128();
+
+	if (zigzag) {
+		__m128i sign = _mm_sub_epi16(fill, _mm_and_si128(lanes, _mm_set1_epi16(1)));
+
+		lanes = _mm_xor_si128(_mm_srli_epi16(lanes, 1), sign);
+		fill = sign;
+	}
+
+	__m128i lo = _mm_unpacklo_epi16(lanes, fill), hi = _mm_unpackhi_epi16(lanes, fill);
+	__m128i lo_fill = _mm_srai_epi32(lo, 31), hi_fill = _mm_srai_epi32(hi, 31);
+
+	_mm_storeu_si128((__m128i*) values, _mm_unpacklo_epi32(lo, lo_fill));
+	_mm_storeu_si128((__m128i*) (values + 2), _mm_unpackhi_epi32(lo, lo_fill));
+	_mm_storeu_si128((__m128i*) (values + 4), _mm_unpacklo_epi32(hi, hi_fill));
+	_mm_storeu_si128((__m128i*) (values + 6), _mm_unpackhi_epi32(hi, hi_fill));
+
+	return entry->n_value;
+}
+
+#endif
+
+int (decode_bm_varints)(struct bm_data *bm_data, uint64_t *values, long *n_value, struct decode_bm_varints va_list) {
+	if (bm_data == NULL || n_value == NULL || *n_value < 0 || (values == NULL && *n_value > 0) || \
+			va_list.offset < 0 || va_list.offset > bm_data->size || (bm_data->data == NULL && bm_data->size > 0)) {
+		va_list.consumed != NULL ? *(va_list.consumed) = 0 : 0;
+		return BM_ERROR_INVAL;
+	}
+
+	uint8_t *in = bm_data->data;
+	long at = va_list.offset, size = bm_data->size, n = 0, n_total = *n_value;
+	int return_status = BM_ERROR_NONE;
+
+#ifdef BM_VARINT_X86
+	int ssse3 = n_total >= 16 && bm_varint_ssse3(), bmi2 = n_total >= 16 && bm_varint_bmi2();
+#endif
+
+	while (n < n_total) {
+#ifdef BM_VARINT_X86
+		/* One movemask gives the terminators of a 16 byte block */
+
+		if (size - at >= 24 && n_total - n >= 16) {
+			unsigned int cont = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (in + at)));
+
+			if (cont == 0) {
+				for (int k = 0; k < 16; k++)
+					values[n + k] = va_list.zigzag ? (uint64_t) zigzag_to_int(in[at + k]) : in[at + k];
+
+				n = n + 16;
+				at = at + 16;
+				continue;
+			}
+
+			int n_shuffle = ssse3 ? decode_shuffle_ssse3(in + at, values + n, cont, va_list.zigzag) : 0;
+
+			if (n_shuffle > 0) {
+				n = n + n_shuffle;
+				at = at + varint_shuffles[cont & 0xFF].n_byte;
+				continue;
+			}
+
+			/* Longer values: each terminator closes one, compacted from a word load */
+
+			int n_word;
+			int start = bmi2 ? decode_words_bmi2(in + at, values + n, &n_word, ~cont & 0xFFFF, va_list.zigzag) : \
+					decode_words(in + at, values + n, &n_word, ~cont & 0xFFFF, va_list.zigzag);
+
+			n = n + n_word;
+			at = at + start;
+
+			if (start > 0)
+				continue;
+		}
+#endif
+
+		uint64_t value;
+		int n_byte = varint_to_int(in + at, size - at, &value);
+
+		if (n_byte <= 0) {
+			return_status = n_byte < 0 ? BM_ERROR_INVAL : BM_ERROR_NONE;
+			break;
+		}
+
+		values[n++] = va_list.zigzag ? (uint64_t) zigzag_to_int(value) : value;
+		at = at + n_byte;
+	}
+
+	*n_value = n;
+	va_list.consumed != NULL ? *(va_list.consumed) = at - va_list.offset : 0;
+
+	return return_status;
+}